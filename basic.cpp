@@ -1,7 +1,8 @@
 #include <dlexer/basic.hpp>
 #include <dlexer/common.hpp>
-
-#define FALLTHROUGH
+#include <fstream>
+#include <algorithm>
+#include <cstring>
 
 using namespace dlexer;
 
@@ -57,22 +58,22 @@ bool BasicLexer::getToken(std::string& out, std::istream& in) {
     return getToken(out, in, this->unit, this->includePrevMode);
 }
 
+char BasicLexer::includeTypeOf(const char* unit, int ulen) const {
+    const int uind = findUnit(bounds.data(), bounds.size(), unit, ulen);
+    return uind == -1 ? NOT_BOUND : incType[uind];
+}
+
 bool BasicLexer::getToken(std::string& out, std::istream& in, char* unit, char& includePrevMode) const {
     if(in.eof()) {
         return false;
     } 
 
     out.clear();
+    auto append = [&]() { out.append(unit, unitLength(unit[0])); };
 
-    int justIncludedMode = NO_INCLUDE;
+    char justIncludedMode = NO_INCLUDE;
     while(true) {
-        justIncludedMode = includePrevMode;
-        if(includePrevMode == RIGHT_INCLUDE) {
-            out.append(unit, unitLength(unit[0]));
-            includePrevMode = NO_INCLUDE;
-        } else if(includePrevMode == STANDALONE || includePrevMode == WEAK_STANDALONE) {
-            out.append(unit, unitLength(unit[0]));
-            includePrevMode = NO_INCLUDE;
+        if(takePrevUnit(includePrevMode, justIncludedMode, append)) {
             return true;
         }
 
@@ -82,32 +83,163 @@ bool BasicLexer::getToken(std::string& out, std::istream& in, char* unit, char&
             return out.length() != 0;
         }
 
-        const int uind = findUnit(bounds.data(), bounds.size(), unit, ulen);
-        if(uind == -1) {
-            out.append(unit, ulen);
-        } else switch(incType[uind]) {
-            case NO_INCLUDE: {
-                if(out.length() == 0) {
-                    continue;
-                }
-                return true;
-            }
-            case LEFT_INCLUDE: out.append(unit, ulen); return true;
-            case RIGHT_INCLUDE: FALLTHROUGH
-            case STANDALONE: {
-                includePrevMode = incType[uind];
-                if(out.length() == 0) {
-                    continue;
-                }
-                return true;
-            }
-            case WEAK_STANDALONE: {
-                includePrevMode = WEAK_STANDALONE;
-                if(out.length() == 0 || justIncludedMode == RIGHT_INCLUDE) {
-                    continue;
-                }
-                return true;
-            }
-        } // switch
-    } // while true
+        if(takeUnit(includeTypeOf(unit, ulen), out.empty(), includePrevMode, justIncludedMode, append)) {
+            return true;
+        }
+    }
+}
+
+/******************************** PUSH API ********************************/
+
+// a step of getToken() for a unit, and the next one as far as it goes
+// without a unit: a standalone unit is a token by itself
+static void pushUnit(const BasicLexer& l, const char* unit, int ulen, BasicLexer::PushState& st, const BasicLexer::Sink& sink) {
+    std::memcpy(st.unit, unit, ulen);
+    auto append = [&]() { st.out.append(st.unit, unitLength(st.unit[0])); };
+    auto emit = [&]() {
+        sink(st.out);
+        st.out.clear();
+    };
+
+    if(BasicLexer::takeUnit(l.includeTypeOf(unit, ulen), st.out.empty(), st.includePrevMode, st.justIncludedMode, append)) {
+        emit();
+    }
+    while(BasicLexer::takePrevUnit(st.includePrevMode, st.justIncludedMode, append)) { emit(); }
+}
+
+void BasicLexer::feed(const char* chunk, size_t len, const Sink& sink) {
+    feed(chunk, len, pushState, sink);
+}
+
+void BasicLexer::finish(const Sink& sink) {
+    finish(pushState, sink);
+}
+
+void BasicLexer::feed(const char* chunk, size_t len, PushState& state, const Sink& sink) const {
+    feedUnits(chunk, len, state.partial, state.partialLen, [&](const char* unit, int ulen) {
+        pushUnit(*this, unit, ulen, state, sink);
+    });
+}
+
+void BasicLexer::finish(PushState& state, const Sink& sink) const {
+    if(state.out.length() != 0) { sink(state.out); }
+    state = PushState();
+}
+
+/****************************** TOKEN RANGE *******************************/
+
+BasicLexer::TokenRange BasicLexer::tokens(std::string_view str) const {
+    return TokenRange{ TokenIterator(*this, str) };
+}
+
+BasicLexer::TokenIterator::TokenIterator(const BasicLexer& lexer, std::string_view str)
+    : lexer(&lexer)
+    , str(str)
+{
+    ++*this;
+}
+
+// getToken() over the string, a token grows by whole units instead of
+// being appended to
+BasicLexer::TokenIterator& BasicLexer::TokenIterator::operator++() {
+    size_t start = std::string_view::npos;
+    size_t end = 0;
+    auto append = [&]() {
+        if(start == std::string_view::npos) { start = unitPos; }
+        end = unitPos + ulen;
+    };
+    auto found = [&]() -> TokenIterator& {
+        token = str.substr(start, end - start);
+        return *this;
+    };
+
+    char justIncludedMode = NO_INCLUDE;
+    while(true) {
+        if(takePrevUnit(includePrevMode, justIncludedMode, append)) {
+            return found();
+        }
+
+        if(pos >= str.size()) {
+            if(start != std::string_view::npos) { return found(); }
+            lexer = nullptr;
+            pos = 0;
+            return *this;
+        }
+        unitPos = pos;
+        ulen = std::min<size_t>(unitLength(str[pos]), str.size() - pos);
+        pos += ulen;
+
+        const char type = lexer->includeTypeOf(str.data() + unitPos, ulen);
+        if(takeUnit(type, start == std::string_view::npos, includePrevMode, justIncludedMode, append)) {
+            return found();
+        }
+    }
+}
+
+/************************** PROGRAM GENERATION ****************************/
+
+static const char* includeTypeName(BasicLexer::IncludeType t) {
+    switch(t) {
+    case BasicLexer::NO_INCLUDE: return "NO_INCLUDE";
+    case BasicLexer::LEFT_INCLUDE: return "LEFT_INCLUDE";
+    case BasicLexer::RIGHT_INCLUDE: return "RIGHT_INCLUDE";
+    case BasicLexer::STANDALONE: return "STANDALONE";
+    case BasicLexer::WEAK_STANDALONE: return "WEAK_STANDALONE";
+    }
+    return "NOT_BOUND";
+}
+
+void BasicLexer::writeAsCppProgram(std::ofstream& out) const {
+    struct Bound {
+        const char* unit;
+        int ulen;
+        IncludeType type;
+    };
+
+    // findUnit() returns the first occurrence, so later duplicates are dropped
+    std::vector<Bound> uniq;
+    for(size_t i = 0, uind = 0; i < bounds.size(); ++uind) {
+        const int ulen = unitLength(bounds[i]);
+        const bool seen = std::any_of(uniq.begin(), uniq.end(), [&](const Bound& b) {
+            return b.ulen == ulen && std::memcmp(b.unit, &bounds[i], ulen) == 0;
+        });
+        if(!seen) { uniq.push_back({ &bounds[i], ulen, incType[uind] }); }
+        i += ulen;
+    }
+
+    std::string cases;
+    std::vector<bool> leadDone(256, false);
+    for(const Bound& lead: uniq) {
+        const unsigned char leadByte = static_cast<unsigned char>(lead.unit[0]);
+        if(leadDone[leadByte]) { continue; }
+        leadDone[leadByte] = true;
+
+        cases += "    case ";
+        cases += std::to_string(leadByte);
+        cases += ":\n";
+        if(lead.ulen == 1) {
+            cases += "        return ";
+            cases += includeTypeName(lead.type);
+            cases += ";\n";
+            continue;
+        }
+
+        for(const Bound& b: uniq) {
+            if(static_cast<unsigned char>(b.unit[0]) != leadByte) { continue; }
+            cases += "        if(ulen == ";
+            cases += std::to_string(b.ulen);
+            cases += " && std::memcmp(unit, ";
+            cases += escapeAsCString(b.unit, b.ulen);
+            cases += ", ";
+            cases += std::to_string(b.ulen);
+            cases += ") == 0) { return ";
+            cases += includeTypeName(b.type);
+            cases += "; }\n";
+        }
+        cases += "        break;\n";
+    }
+
+    out << readTemplate("templates/basic/prelude.cpp");
+    out << cases;
+    out << readTemplate("templates/basic/post.cpp");
 }
@@ -0,0 +1,148 @@
+#include <dlexer/batchlexer.hpp>
+#include <algorithm>
+#include <cstring>
+
+namespace dlexer {
+
+BatchLexer::BatchLexer(const RegexLexer& lexer, unsigned threads): lexer(lexer) {
+    if(threads == 0) { threads = std::max(std::thread::hardware_concurrency(), 1u); }
+    contexts.resize(threads);
+    for(size_t i = 0; i + 1 < threads; ++i) {
+        workers.emplace_back(&BatchLexer::workerLoop, this, i);
+    }
+}
+
+BatchLexer::~BatchLexer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    started.notify_all();
+    for(std::thread& t: workers) { t.join(); }
+}
+
+void BatchLexer::getTokens(const std::vector<std::string_view>& records, RecordBatch& out) {
+    const size_t chunkCount = (records.size() + ChunkRecords - 1) / ChunkRecords;
+    if(chunks.size() < chunkCount) { chunks.resize(chunkCount); }
+    this->records = &records;
+    nextChunk = 0;
+
+    // a single chunk isn't worth waking the workers
+    if(workers.empty() || chunkCount <= 1) {
+        work(contexts.back());
+    } else {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            generation++;
+            busy = static_cast<unsigned>(workers.size());
+        }
+        started.notify_all();
+        work(contexts.back());
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this]() { return busy == 0; });
+    }
+    this->records = nullptr;
+
+    out.stride = 1 + lexer.getGroupCount();
+    out.str.resize(records.size());
+    out.first.resize(records.size() + 1);
+    out.first[0] = 0;
+    size_t spanCount = 0;
+    for(size_t c = 0; c < chunkCount; ++c) { spanCount += chunks[c].spans.size(); }
+    out.spans.clear();
+    out.matched.clear();
+    out.spans.reserve(spanCount);
+    out.matched.reserve(spanCount);
+
+    for(size_t c = 0; c < chunkCount; ++c) {
+        const Chunk& chunk = chunks[c];
+        const size_t base = c * ChunkRecords;
+        for(size_t i = 0; i < chunk.counts.size(); ++i) {
+            out.str[base + i] = records[base + i].data();
+            out.first[base + i + 1] = out.first[base + i] + chunk.counts[i];
+        }
+        out.spans.insert(out.spans.end(), chunk.spans.begin(), chunk.spans.end());
+        out.matched.insert(out.matched.end(), chunk.matched.begin(), chunk.matched.end());
+    }
+}
+
+void BatchLexer::getLineTokens(std::string_view text, RecordBatch& out) {
+    splitLines(text, lines);
+    getTokens(lines, out);
+}
+
+// memchr() is vectorized by the C library, so the index is built at
+// about memory speed, and lines are lexed in parallel as records
+void BatchLexer::splitLines(std::string_view text, std::vector<std::string_view>& lines) {
+    lines.clear();
+    const char* p = text.data();
+    const char* const end = p + text.size();
+    while(p < end) {
+        const char* nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        if(nl == nullptr) { nl = end; }
+        lines.push_back(std::string_view(p, nl - p));
+        p = nl + 1;
+    }
+}
+
+void BatchLexer::workerLoop(size_t ctx) {
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while(true) {
+        started.wait(lock, [&]() { return stopping || generation != seen; });
+        if(stopping) { break; }
+        seen = generation;
+
+        lock.unlock();
+        work(contexts[ctx]);
+        lock.lock();
+
+        if(--busy == 0) { done.notify_one(); }
+    }
+}
+
+void BatchLexer::work(RegexData& data) {
+    const size_t chunkCount = (records->size() + ChunkRecords - 1) / ChunkRecords;
+    while(true) {
+        const size_t c = nextChunk.fetch_add(1, std::memory_order_relaxed);
+        if(c >= chunkCount) { break; }
+        lexChunk(c, data);
+    }
+}
+
+// getTokens() of RegexLexer, with records for strings
+void BatchLexer::lexChunk(size_t c, RegexData& data) {
+    Chunk& chunk = chunks[c];
+    chunk.spans.clear();
+    chunk.matched.clear();
+    chunk.counts.clear();
+
+    const size_t end = std::min((c + 1) * ChunkRecords, records->size());
+    for(size_t r = c * ChunkRecords; r < end; ++r) {
+        const std::string_view rec = (*records)[r];
+        const size_t before = chunk.spans.size();
+        if(cache != nullptr && cache->find(rec, chunk.spans, chunk.matched)) {
+            chunk.counts.push_back((chunk.spans.size() - before) / (1 + lexer.getGroupCount()));
+            continue;
+        }
+
+        data.str = rec.data();
+        data.strLen = rec.size();
+        data.rewindTo(0);
+
+        size_t count = 0;
+        const char* start;
+        const char* tokenEnd;
+        while(lexer.getToken(&start, &tokenEnd, data)) {
+            lexer.appendSpans(start, tokenEnd, data, chunk.spans, chunk.matched);
+            count++;
+        }
+        chunk.counts.push_back(count);
+        if(cache != nullptr) {
+            cache->insert(rec, chunk.spans.data() + before, chunk.matched.data() + before, chunk.spans.size() - before);
+        }
+    }
+}
+
+} // namespace dlexer
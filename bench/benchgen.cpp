@@ -0,0 +1,34 @@
+#include <dlexer/basic.hpp>
+#include <dlexer/typed.hpp>
+#include <dlexer/regex.hpp>
+#include "patterns.hpp"
+#include <fstream>
+#include <iostream>
+#include <string>
+
+using namespace dlexer;
+
+// writes scanner for one of bench patterns, must be run from build root
+int main(int argc, char** argv) {
+    if(argc != 3) {
+        std::cerr << "usage: benchgen basic|typed|regex <output>\n";
+        return 1;
+    }
+
+    const std::string kind = argv[1];
+    if(kind == "regex") {
+        RegexLexer(regexBenchPattern).generateCProgram(argv[2]);
+        return 0;
+    }
+
+    std::ofstream out(argv[2]);
+    if(kind == "basic") {
+        BasicLexer(basicBenchPattern).writeAsCppProgram(out);
+    } else if(kind == "typed") {
+        TypedLexer(typedBenchPattern).writeAsCppProgram(out);
+    } else {
+        std::cerr << "unknown scanner kind: " << kind << '\n';
+        return 1;
+    }
+    return !out.good();
+}
@@ -0,0 +1,195 @@
+#include "corpus.hpp"
+#include <fstream>
+#include <iterator>
+
+namespace {
+
+struct Rng {
+    uint64_t state;
+
+    uint32_t next() {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        return static_cast<uint32_t>(state >> 33);
+    }
+    uint32_t below(uint32_t n) { return next() % n; }
+
+    template<size_t N>
+    const char* pick(const char* const (&arr)[N]) { return arr[below(N)]; }
+};
+
+const char* const words[] = {
+    "request", "user", "session", "value", "index", "buffer", "token",
+    "parser", "count", "result", "item", "config", "handler", "x", "id",
+};
+
+const char* const levels[] = { "INFO", "INFO", "INFO", "DEBUG", "WARN", "ERROR" };
+
+const char* const paths[] = {
+    "/api/v1/items", "/api/v1/users", "/health", "/static/app.js", "/login",
+};
+
+const char* const keywords[] = {
+    "int", "return", "if", "else", "for", "while", "const", "auto", "struct",
+};
+
+const char* const ops[] = {
+    " = ", " + ", " - ", " * ", " / ", " == ", " != ", " < ", " && ", "->", ".",
+};
+
+const char* const utfWords[] = {
+    "привет", "мир", "лексер", "строка", "данные", "κόσμος", "λέξη",
+    "日本語", "テキスト", "汉字", "słowo", "żółw", "naïve", "café", "ёж",
+};
+
+const char* const utfPuncts[] = { " ", " ", " ", ", ", ". ", " — ", "; ", "\n", " «", "» " };
+
+void appendNumber(std::string& out, uint32_t n, int width) {
+    std::string digits = std::to_string(n);
+    while(static_cast<int>(digits.size()) < width) { digits.insert(digits.begin(), '0'); }
+    out += digits;
+}
+
+std::string makeLogs(size_t size, Rng& rng) {
+    std::string out;
+    while(out.size() < size) {
+        out += "2024-";
+        appendNumber(out, 1 + rng.below(12), 2);
+        out += '-';
+        appendNumber(out, 1 + rng.below(28), 2);
+        out += 'T';
+        appendNumber(out, rng.below(24), 2);
+        out += ':';
+        appendNumber(out, rng.below(60), 2);
+        out += ':';
+        appendNumber(out, rng.below(60), 2);
+        out += '.';
+        appendNumber(out, rng.below(1000), 3);
+        out += "Z ";
+        out += rng.pick(levels);
+        out += " [worker-";
+        out += std::to_string(rng.below(32));
+        out += "] ";
+        out += rng.pick(words);
+        out += " id=";
+        appendNumber(out, rng.next() % 100000000, 8);
+        out += " path=";
+        out += rng.pick(paths);
+        out += " status=";
+        out += std::to_string(rng.below(5) == 0 ? 404 : 200);
+        out += " latency=";
+        out += std::to_string(rng.below(500));
+        out += "ms\n";
+    }
+    return out;
+}
+
+std::string makeSource(size_t size, Rng& rng) {
+    std::string out;
+    int depth = 0;
+    while(out.size() < size) {
+        out.append(4 * depth, ' ');
+        switch(rng.below(6)) {
+        case 0: {
+            out += rng.pick(keywords);
+            out += ' ';
+            out += rng.pick(words);
+            out += '(';
+            out += rng.pick(words);
+            out += ") {\n";
+            depth++;
+        } break;
+        case 1: {
+            if(depth > 0) {
+                out.resize(out.size() - 4);
+                out += "}\n";
+                depth--;
+                break;
+            }
+        } // fallthrough
+        case 2: {
+            out += "// ";
+            out += rng.pick(words);
+            out += ' ';
+            out += rng.pick(words);
+            out += '\n';
+        } break;
+        default: {
+            out += rng.pick(words);
+            out += '_';
+            out += std::to_string(rng.below(100));
+            out += rng.pick(ops);
+            out += rng.pick(words);
+            out += rng.pick(ops);
+            out += std::to_string(rng.below(100000));
+            out += ";\n";
+        } break;
+        }
+    }
+    return out;
+}
+
+std::string makeCsv(size_t size, Rng& rng) {
+    std::string out = "id,name,amount,city,comment\n";
+    while(out.size() < size) {
+        out += std::to_string(rng.below(1000000));
+        out += ',';
+        out += rng.pick(words);
+        out += ',';
+        out += std::to_string(rng.below(100000));
+        out += '.';
+        appendNumber(out, rng.below(100), 2);
+        out += ',';
+        out += rng.pick(paths) + 1;
+        out += ",\"";
+        out += rng.pick(words);
+        out += ' ';
+        out += rng.pick(words);
+        out += "\"\n";
+    }
+    return out;
+}
+
+std::string makeUtf8(size_t size, Rng& rng) {
+    std::string out;
+    while(out.size() < size) {
+        out += rng.pick(utfWords);
+        out += rng.pick(utfPuncts);
+    }
+    return out;
+}
+
+// log lines repeated from a pool of 100, as in logs of a service
+// doing the same few things, where TokenCache pays off
+std::string makeRecords(size_t size, Rng& rng) {
+    std::vector<std::string> lines;
+    for(int i = 0; i < 100; ++i) { lines.push_back(makeLogs(1, rng)); }
+
+    std::string out;
+    while(out.size() < size) { out += lines[rng.below(lines.size())]; }
+    return out;
+}
+
+} // namespace
+
+std::vector<Corpus> makeSyntheticCorpora(size_t size, uint64_t seed) {
+    Rng rng{ seed };
+    std::vector<Corpus> out;
+    out.push_back({ "logs", makeLogs(size, rng) });
+    out.push_back({ "source", makeSource(size, rng) });
+    out.push_back({ "csv", makeCsv(size, rng) });
+    out.push_back({ "utf8", makeUtf8(size, rng) });
+    out.push_back({ "records", makeRecords(size, rng) });
+    return out;
+}
+
+bool readCorpusFile(const std::string& path, Corpus& out) {
+    std::ifstream in(path, std::ios::binary);
+    if(!in) { return false; }
+
+    out.name = path;
+    out.text.assign(
+        (std::istreambuf_iterator<char>(in)),
+        (std::istreambuf_iterator<char>())
+    );
+    return true;
+}
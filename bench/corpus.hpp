@@ -0,0 +1,17 @@
+#ifndef DLEXER_BENCH_CORPUS_H_
+#define DLEXER_BENCH_CORPUS_H_
+#include <string>
+#include <vector>
+#include <cstdint>
+
+struct Corpus {
+    std::string name;
+    std::string text;
+};
+
+// Synthetic corpora are generated from a fixed seed with an LCG, so
+// they are byte-identical on every platform and run.
+std::vector<Corpus> makeSyntheticCorpora(size_t size, uint64_t seed);
+bool readCorpusFile(const std::string& path, Corpus& out);
+
+#endif // DLEXER_BENCH_CORPUS_H_
@@ -0,0 +1,461 @@
+#include <dlexer/basic.hpp>
+#include <dlexer/typed.hpp>
+#include <dlexer/regex.hpp>
+#include <dlexer/batchlexer.hpp>
+#include <dlexer/static_basic.hpp>
+#include <dlexer/static_regex.hpp>
+#include "patterns.hpp"
+#include "corpus.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// scanners generated by benchgen
+#define DLEXER_NO_MAIN
+#define DLEXER_GEN_NAMESPACE gen_basic
+#include "basic_gen.cpp"
+#undef DLEXER_GEN_NAMESPACE
+#define DLEXER_GEN_NAMESPACE gen_typed
+#include "typed_gen.cpp"
+#undef DLEXER_GEN_NAMESPACE
+
+// regex_gen.c is compiled as C; LineAt is an int-sized enum there
+extern "C" int getToken(
+    const char* str, const int* strLen, int* startPos,
+    int* pos, int* at, char* unit, int* ulen,
+    int* groups, int groupsCount, int state,
+    int thisAt, int thisStartPos, int thisPos
+);
+
+using namespace dlexer;
+
+/***************************** ALLOCATION COUNTING ****************************/
+
+// BatchLexer workers allocate too; they are done with a batch before
+// the counts are read, so increments need no ordering
+static std::atomic<size_t> allocCount{0};
+static std::atomic<size_t> allocBytes{0};
+
+void* operator new(size_t size) {
+    allocCount.fetch_add(1, std::memory_order_relaxed);
+    allocBytes.fetch_add(size, std::memory_order_relaxed);
+    if(void* p = std::malloc(size ? size : 1)) { return p; }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+/********************************** LEXERS ************************************/
+
+// Each lexer calls onToken() once per token and returns number of tokens.
+// Lexers reading std::istream get a fresh stringstream, its construction
+// is part of the measurement.
+
+struct BasicBench {
+    BasicLexer l{ basicBenchPattern };
+
+    template<typename F>
+    size_t run(const std::string& text, F&& onToken) {
+        std::stringstream in(text);
+        std::string out;
+        char unit[4];
+        char mode = BasicLexer::NO_INCLUDE;
+        size_t count = 0;
+        while(l.getToken(out, in, unit, mode)) { onToken(); count++; }
+        return count;
+    }
+};
+
+struct BasicRangeBench {
+    BasicLexer l{ basicBenchPattern };
+
+    template<typename F>
+    size_t run(const std::string& text, F&& onToken) {
+        size_t count = 0;
+        for(const std::string_view token: l.tokens(text)) { (void)token; onToken(); count++; }
+        return count;
+    }
+};
+
+struct StaticBasicBench {
+    template<typename F>
+    size_t run(const std::string& text, F&& onToken) {
+        std::stringstream in(text);
+        std::string out;
+        static_basic<basicBenchPattern> l;
+        size_t count = 0;
+        while(l.getToken(out, in)) { onToken(); count++; }
+        return count;
+    }
+};
+
+struct GenBasicBench {
+    template<typename F>
+    size_t run(const std::string& text, F&& onToken) {
+        std::stringstream in(text);
+        std::string out;
+        char unit[4];
+        char mode = gen_basic::NO_INCLUDE;
+        size_t count = 0;
+        while(gen_basic::getToken(out, in, unit, mode)) { onToken(); count++; }
+        return count;
+    }
+};
+
+struct TypedBench {
+    TypedLexer l{ typedBenchPattern };
+
+    template<typename F>
+    size_t run(const std::string& text, F&& onToken) {
+        std::stringstream in(text);
+        std::string out;
+        TypedLexer::Data data = {0};
+        size_t count = 0;
+        while(l.getToken(out, in, data)) { onToken(); count++; }
+        return count;
+    }
+};
+
+struct TypedRangeBench {
+    TypedLexer l{ typedBenchPattern };
+
+    template<typename F>
+    size_t run(const std::string& text, F&& onToken) {
+        size_t count = 0;
+        for(const TypedLexer::Token& token: l.tokens(text)) { (void)token; onToken(); count++; }
+        return count;
+    }
+};
+
+struct TypedRunsBench {
+    TypedLexer l{ typedBenchPattern };
+    std::vector<TypedLexer::Run> runs;
+
+    template<typename F>
+    size_t run(const std::string& text, F&& onToken) {
+        size_t count = 0;
+        l.getRuns(text, runs);
+        for(const TypedLexer::Run& r: runs) {
+            if(r.type == -1) { continue; }
+            onToken();
+            count++;
+        }
+        return count;
+    }
+};
+
+struct GenTypedBench {
+    template<typename F>
+    size_t run(const std::string& text, F&& onToken) {
+        size_t count = 0;
+        gen_typed::scan(text.data(), text.size(), [&](int, const char*, const char*) {
+            onToken();
+            count++;
+        });
+        return count;
+    }
+};
+
+struct RegexBench {
+    RegexLexer l{ regexBenchPattern };
+
+    template<typename F>
+    size_t run(const std::string& text, F&& onToken) {
+        RegexData data(text.data(), text.size());
+        const char* start;
+        const char* end;
+        size_t count = 0;
+        while(l.getToken(&start, &end, data)) { onToken(); count++; }
+        return count;
+    }
+};
+
+struct RegexRangeBench {
+    RegexLexer l{ regexBenchPattern };
+
+    template<typename F>
+    size_t run(const std::string& text, F&& onToken) {
+        size_t count = 0;
+        for(const RegexLexer::Token& token: l.tokens(text)) { (void)token; onToken(); count++; }
+        return count;
+    }
+};
+
+// line mode; tokens are reported after the batch
+struct RegexBatchBench {
+    RegexLexer l{ regexBenchPattern };
+    BatchLexer batchLexer{ l };
+    RecordBatch batch;
+    TokenCache cache;
+
+    // with a cache of cacheBytes, kept warm between runs
+    explicit RegexBatchBench(size_t cacheBytes = 0): cache(cacheBytes) {
+        if(cacheBytes != 0) { batchLexer.setCache(&cache); }
+    }
+
+    template<typename F>
+    size_t run(const std::string& text, F&& onToken) {
+        batchLexer.getLineTokens(text, batch);
+
+        const size_t count = batch.spans.size() / batch.stride;
+        for(size_t k = 0; k < count; ++k) { onToken(); }
+        return count;
+    }
+};
+
+// whether onToken() is called as tokens are found, so the time between
+// calls is a token latency
+template<typename L>
+static bool hasTokenLatency(const L&) { return true; }
+static bool hasTokenLatency(const RegexBatchBench&) { return false; }
+
+struct StaticRegexBench {
+    template<typename F>
+    size_t run(const std::string& text, F&& onToken) {
+        RegexData data(text.data(), text.size());
+        const char* start;
+        const char* end;
+        size_t count = 0;
+        while(static_regex<regexBenchPattern>::getToken(&start, &end, data)) { onToken(); count++; }
+        return count;
+    }
+};
+
+struct GenRegexBench {
+    template<typename F>
+    size_t run(const std::string& text, F&& onToken) {
+        const int len = static_cast<int>(text.size());
+        int groups[2 * 2];
+        char unit[4];
+        int ulen = 0;
+        int startPos = 0;
+        int pos = 0;
+        int at = 0;
+        size_t count = 0;
+        while(getToken(text.data(), &len, &startPos, &pos, &at, unit, &ulen,
+            groups, sizeof(groups)/sizeof(groups[0]), 0, 0, 0, 0)) {
+            onToken();
+            count++;
+        }
+        return count;
+    }
+};
+
+/******************************** MEASUREMENT *********************************/
+
+struct Options {
+    size_t size = 1 << 20;
+    int repeat = 5;
+    uint64_t seed = 42;
+    std::string out;
+    std::string filter;
+    std::vector<std::string> files;
+};
+
+struct Result {
+    std::string lexer;
+    std::string corpus;
+    size_t bytes = 0;
+    size_t tokens = 0;
+    double seconds = 0;
+    bool hasLatency = false;
+    double latency[5] = {0}; // p50, p90, p99, p999, max in ns
+    size_t allocs = 0;
+    size_t allocatedBytes = 0;
+};
+
+using Clock = std::chrono::steady_clock;
+
+static double percentile(const std::vector<double>& sorted, double p) {
+    if(sorted.empty()) { return 0; }
+    const size_t i = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[i];
+}
+
+template<typename L>
+static Result measure(const char* name, L& l, const Corpus& c, const Options& opt) {
+    Result r;
+    r.lexer = name;
+    r.corpus = c.name;
+    r.bytes = c.text.size();
+
+    // throughput is the best of repeated runs, allocations are taken
+    // from the first one
+    for(int i = 0; i < opt.repeat; ++i) {
+        const size_t countBefore = allocCount.load(std::memory_order_relaxed);
+        const size_t bytesBefore = allocBytes.load(std::memory_order_relaxed);
+        const auto start = Clock::now();
+        r.tokens = l.run(c.text, []() {});
+        const double sec = std::chrono::duration<double>(Clock::now() - start).count();
+
+        if(i == 0) {
+            r.allocs = allocCount.load(std::memory_order_relaxed) - countBefore;
+            r.allocatedBytes = allocBytes.load(std::memory_order_relaxed) - bytesBefore;
+            r.seconds = sec;
+        }
+        r.seconds = std::min(r.seconds, sec);
+    }
+
+    r.hasLatency = hasTokenLatency(l);
+    if(!r.hasLatency) { return r; }
+
+    // separate pass, as reading clock per token slows lexers down
+    std::vector<double> lat;
+    lat.reserve(r.tokens);
+    auto last = Clock::now();
+    l.run(c.text, [&]() {
+        const auto now = Clock::now();
+        lat.push_back(std::chrono::duration<double, std::nano>(now - last).count());
+        last = now;
+    });
+    std::sort(lat.begin(), lat.end());
+    r.latency[0] = percentile(lat, 0.5);
+    r.latency[1] = percentile(lat, 0.9);
+    r.latency[2] = percentile(lat, 0.99);
+    r.latency[3] = percentile(lat, 0.999);
+    r.latency[4] = lat.empty() ? 0 : lat.back();
+    return r;
+}
+
+/*********************************** OUTPUT ***********************************/
+
+static void writeJsonString(std::ostream& out, const std::string& s) {
+    out << '"';
+    for(const char c: s) {
+        switch(c) {
+        case '"': out << "\\\""; break;
+        case '\\': out << "\\\\"; break;
+        case '\n': out << "\\n"; break;
+        default: out << c; break;
+        }
+    }
+    out << '"';
+}
+
+static void writeJson(std::ostream& out, const Options& opt, const std::vector<Result>& results) {
+    out << "{\n  \"size\": " << opt.size
+        << ",\n  \"repeat\": " << opt.repeat
+        << ",\n  \"seed\": " << opt.seed
+        << ",\n  \"results\": [";
+
+    for(size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        const double sec = r.seconds > 0 ? r.seconds : 1e-9;
+        out << (i ? ",\n" : "\n") << "    {\"lexer\": ";
+        writeJsonString(out, r.lexer);
+        out << ", \"corpus\": ";
+        writeJsonString(out, r.corpus);
+        out << ", \"bytes\": " << r.bytes
+            << ", \"tokens\": " << r.tokens
+            << ", \"seconds\": " << r.seconds
+            << ", \"mib_per_s\": " << (r.bytes / sec / (1 << 20))
+            << ", \"tokens_per_s\": " << (r.tokens / sec);
+        if(r.hasLatency) {
+            out << ", \"latency_ns\": {\"p50\": " << r.latency[0]
+                << ", \"p90\": " << r.latency[1]
+                << ", \"p99\": " << r.latency[2]
+                << ", \"p999\": " << r.latency[3]
+                << ", \"max\": " << r.latency[4] << '}';
+        }
+        out << ", \"allocations\": " << r.allocs
+            << ", \"allocated_bytes\": " << r.allocatedBytes << '}';
+    }
+    out << "\n  ]\n}\n";
+}
+
+/************************************ MAIN ************************************/
+
+static void usage() {
+    std::cerr << "usage: dlexer_bench [--size BYTES] [--repeat N] [--seed N]"
+        " [--filter SUBSTR] [--out FILE.json] [--file PATH]...\n";
+    std::exit(1);
+}
+
+static Options parseOptions(int argc, char** argv) {
+    Options opt;
+    for(int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if(i + 1 >= argc) { usage(); }
+
+        const char* val = argv[++i];
+        if(arg == "--size") { opt.size = std::stoul(val); }
+        else if(arg == "--repeat") { opt.repeat = std::max(1, std::stoi(val)); }
+        else if(arg == "--seed") { opt.seed = std::stoull(val); }
+        else if(arg == "--filter") { opt.filter = val; }
+        else if(arg == "--out") { opt.out = val; }
+        else if(arg == "--file") { opt.files.push_back(val); }
+        else { usage(); }
+    }
+    return opt;
+}
+
+int main(int argc, char** argv) {
+    const Options opt = parseOptions(argc, argv);
+
+    std::vector<Corpus> corpora = makeSyntheticCorpora(opt.size, opt.seed);
+    for(const std::string& path: opt.files) {
+        Corpus c;
+        if(!readCorpusFile(path, c)) {
+            std::cerr << "can't read corpus file: " << path << '\n';
+            return 1;
+        }
+        corpora.push_back(std::move(c));
+    }
+
+    BasicBench basic;
+    BasicRangeBench basicRange;
+    StaticBasicBench staticBasic;
+    GenBasicBench genBasic;
+    TypedBench typed;
+    TypedRangeBench typedRange;
+    TypedRunsBench typedRuns;
+    GenTypedBench genTyped;
+    RegexBench regex;
+    RegexRangeBench regexRange;
+    RegexBatchBench regexBatch;
+    RegexBatchBench regexCachedBatch{ 64 << 20 };
+    StaticRegexBench staticRegex;
+    GenRegexBench genRegex;
+
+    std::vector<Result> results;
+    for(const Corpus& c: corpora) {
+        auto add = [&](const char* name, auto& l) {
+            const std::string key = std::string(name) + "/" + c.name;
+            if(key.find(opt.filter) == std::string::npos) { return; }
+
+            std::cerr << key << "...\n";
+            results.push_back(measure(name, l, c, opt));
+        };
+        add("BasicLexer", basic);
+        add("BasicLexer::tokens", basicRange);
+        add("static_basic", staticBasic);
+        add("generated_basic", genBasic);
+        add("TypedLexer", typed);
+        add("TypedLexer::tokens", typedRange);
+        add("TypedLexer::getRuns", typedRuns);
+        add("generated_typed", genTyped);
+        add("RegexLexer", regex);
+        add("RegexLexer::tokens", regexRange);
+        add("BatchLexer::getLineTokens", regexBatch);
+        add("BatchLexer::getLineTokens+TokenCache", regexCachedBatch);
+        add("static_regex", staticRegex);
+        add("generated_regex", genRegex);
+    }
+
+    if(opt.out.empty()) {
+        writeJson(std::cout, opt, results);
+        return 0;
+    }
+
+    std::ofstream out(opt.out);
+    writeJson(out, opt, results);
+    return !out.good();
+}
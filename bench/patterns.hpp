@@ -0,0 +1,16 @@
+#ifndef DLEXER_BENCH_PATTERNS_H_
+#define DLEXER_BENCH_PATTERNS_H_
+
+// patterns shared by generators of C/C++ scanners and benchmarks
+
+static constexpr char basicBenchPattern[] = " \t\n,^;^=^\"!";
+
+static constexpr char typedBenchPattern[] =
+    "word \"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_\" "
+    "number \"0123456789\" "
+    "space \" \\t\\n\" "
+    "punct \".,;:-+*/=()[]{}<>\"";
+
+static constexpr char regexBenchPattern[] = "([a-zA-Z_]+)|([0-9]+)";
+
+#endif // DLEXER_BENCH_PATTERNS_H_
@@ -0,0 +1,269 @@
+#include <dlexer/blockreader.hpp>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#ifdef DLEXER_HAS_ZLIB
+#include <zlib.h>
+#endif
+#ifdef DLEXER_HAS_ZSTD
+#include <zstd.h>
+#endif
+
+namespace dlexer {
+
+// Reads up to len bytes into dst, fewer only at the end of the stream,
+// which is when ended is set.
+struct BlockReader::Source {
+    std::istream& in;
+    // bytes taken from in by detect(), given out before the rest of it
+    std::string head;
+    size_t headPos = 0;
+    bool ended = false;
+    bool failed = false;
+
+    Source(std::istream& in): in(in) {}
+    virtual ~Source() {}
+
+    virtual size_t read(char* dst, size_t len) {
+        const size_t res = readIn(dst, len);
+        if(res < len) { end(in.bad()); }
+        return res;
+    }
+
+    // head, then in; fewer than len bytes only at the end of in
+    size_t readIn(char* dst, size_t len) {
+        const size_t fromHead = std::min(len, head.size() - headPos);
+        std::memcpy(dst, head.data() + headPos, fromHead);
+        headPos += fromHead;
+        if(fromHead == len) { return len; }
+
+        in.read(dst + fromHead, len - fromHead);
+        return fromHead + in.gcount();
+    }
+
+    void end(bool failed) {
+        ended = true;
+        this->failed = failed;
+    }
+};
+
+// compressed input is read in blocks of this size
+static const size_t CompressedBlockSize = 1 << 16;
+
+#ifdef DLEXER_HAS_ZLIB
+struct GzipSource: BlockReader::Source {
+    z_stream z = {};
+    std::unique_ptr<char[]> buf{ new char[CompressedBlockSize] };
+    // a member ended and no input of the next one was taken yet
+    bool atMemberStart = true;
+
+    // 32 makes inflate() detect gzip or zlib header
+    GzipSource(std::istream& in): Source(in) {
+        if(inflateInit2(&z, 15 + 32) != Z_OK) { end(true); }
+    }
+    ~GzipSource() override { inflateEnd(&z); }
+
+    size_t read(char* dst, size_t len) override {
+        z.next_out = reinterpret_cast<Bytef*>(dst);
+        z.avail_out = len;
+        while(!ended && z.avail_out != 0) {
+            const uInt before = z.avail_in;
+            const int res = inflate(&z, Z_NO_FLUSH);
+            if(z.avail_in != before) { atMemberStart = false; }
+            if(res == Z_STREAM_END) {
+                inflateReset(&z);
+                atMemberStart = true;
+                continue;
+            }
+            if((res != Z_OK && res != Z_BUF_ERROR) || (res == Z_BUF_ERROR && z.avail_in != 0)) {
+                end(true);
+                break;
+            }
+            if(z.avail_out == 0 || z.avail_in != 0) { continue; }
+
+            z.next_in = reinterpret_cast<Bytef*>(buf.get());
+            z.avail_in = readIn(buf.get(), CompressedBlockSize);
+            // a member cut in the middle is truncated input
+            if(z.avail_in == 0) { end(in.bad() || !atMemberStart); }
+        }
+        return len - z.avail_out;
+    }
+};
+#endif
+
+#ifdef DLEXER_HAS_ZSTD
+struct ZstdSource: BlockReader::Source {
+    ZSTD_DStream* z = ZSTD_createDStream();
+    std::unique_ptr<char[]> buf{ new char[CompressedBlockSize] };
+    ZSTD_inBuffer input = { nullptr, 0, 0 };
+    // last ZSTD_decompressStream() result, 0 when a frame is complete
+    size_t pending = 0;
+
+    ZstdSource(std::istream& in): Source(in) {
+        if(z == nullptr || ZSTD_isError(ZSTD_initDStream(z))) { end(true); }
+    }
+    ~ZstdSource() override { ZSTD_freeDStream(z); }
+
+    size_t read(char* dst, size_t len) override {
+        ZSTD_outBuffer out = { dst, len, 0 };
+        while(!ended && out.pos != out.size) {
+            const size_t res = ZSTD_decompressStream(z, &out, &input);
+            if(ZSTD_isError(res)) {
+                end(true);
+                break;
+            }
+            pending = res;
+            if(out.pos == out.size || input.pos != input.size) { continue; }
+
+            input = { buf.get(), readIn(buf.get(), CompressedBlockSize), 0 };
+            if(input.size == 0) { end(in.bad() || pending != 0); }
+        }
+        return out.pos;
+    }
+};
+#endif
+
+bool BlockReader::supports(Compression c) {
+    switch(c) {
+    case NONE: case DETECT: return true;
+#ifdef DLEXER_HAS_ZLIB
+    case GZIP: return true;
+#endif
+#ifdef DLEXER_HAS_ZSTD
+    case ZSTD: return true;
+#endif
+    default: return false;
+    }
+}
+
+// Takes the first bytes into head rather than seeking back, so that
+// pipes and other streams that can't seek work too; the source gives
+// them out first.
+static BlockReader::Compression detect(std::istream& in, std::string& head) {
+    static const unsigned char gzipMagic[2] = { 0x1f, 0x8b };
+    static const unsigned char zstdMagic[4] = { 0x28, 0xb5, 0x2f, 0xfd };
+    head.resize(sizeof(zstdMagic));
+    in.read(&head[0], head.size());
+    head.resize(in.gcount());
+
+    if(head.size() >= sizeof(gzipMagic) && std::memcmp(head.data(), gzipMagic, sizeof(gzipMagic)) == 0) {
+        return BlockReader::GZIP;
+    }
+    if(head.size() >= sizeof(zstdMagic) && std::memcmp(head.data(), zstdMagic, sizeof(zstdMagic)) == 0) {
+        return BlockReader::ZSTD;
+    }
+    return BlockReader::NONE;
+}
+
+static std::unique_ptr<BlockReader::Source> makeSource(std::istream& in, BlockReader::Compression c) {
+    std::string head;
+    if(c == BlockReader::DETECT) { c = detect(in, head); }
+
+    std::unique_ptr<BlockReader::Source> res;
+    switch(c) {
+#ifdef DLEXER_HAS_ZLIB
+    case BlockReader::GZIP: res.reset(new GzipSource(in)); break;
+#endif
+#ifdef DLEXER_HAS_ZSTD
+    case BlockReader::ZSTD: res.reset(new ZstdSource(in)); break;
+#endif
+    default: {
+        res.reset(new BlockReader::Source(in));
+        if(c != BlockReader::NONE) { res->end(true); }
+    } break;
+    }
+    res->head = std::move(head);
+    return res;
+}
+
+BlockReader::BlockReader(std::istream& in, size_t blockSize, size_t blockCount, Compression compression)
+    : source(makeSource(in, compression))
+    , blockSize(std::max<size_t>(blockSize, 1))
+    , ring(std::max<size_t>(blockCount, 1))
+{
+    for(Block& b: ring) { b.data.reset(new char[this->blockSize]); }
+    thread = std::thread(&BlockReader::readLoop, this);
+}
+
+BlockReader::BlockReader(std::unique_ptr<std::istream> owned, size_t blockSize, size_t blockCount,
+    Compression compression
+)
+    : BlockReader(*owned, blockSize, blockCount, compression)
+{
+    this->owned = std::move(owned);
+}
+
+BlockReader::~BlockReader() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    changed.notify_all();
+    thread.join();
+}
+
+std::unique_ptr<BlockReader> BlockReader::fromFile(const std::string& path, std::string* error,
+    size_t blockSize, size_t blockCount, Compression compression
+) {
+    if(!supports(compression)) {
+        if(error != nullptr) { *error = "built without the decompressor"; }
+        return nullptr;
+    }
+
+    std::unique_ptr<std::istream> in(new std::ifstream(path, std::ios::binary));
+    if(!*in) {
+        if(error != nullptr) { *error = "can't open file"; }
+        return nullptr;
+    }
+    return std::unique_ptr<BlockReader>(new BlockReader(std::move(in), blockSize, blockCount, compression));
+}
+
+bool BlockReader::next(const char** data, size_t* len) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if(holding) {
+        head = (head + 1) % ring.size();
+        filled--;
+        holding = false;
+        changed.notify_all();
+    }
+
+    changed.wait(lock, [this]() { return filled != 0 || ended; });
+    if(filled == 0) { return false; }
+
+    holding = true;
+    *data = ring[head].data.get();
+    *len = ring[head].len;
+    return true;
+}
+
+bool BlockReader::failed() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return readFailed;
+}
+
+// reads with the lock released, the block being filled is not in the
+// ring's filled part, so the consumer doesn't look at it
+void BlockReader::readLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while(true) {
+        changed.wait(lock, [this]() { return filled < ring.size() || stopping; });
+        if(stopping) { break; }
+
+        Block& b = ring[(head + filled) % ring.size()];
+        lock.unlock();
+        b.len = source->ended ? 0 : source->read(b.data.get(), blockSize);
+        lock.lock();
+
+        if(b.len != 0) { filled++; }
+        if(source->ended) {
+            ended = true;
+            readFailed = source->failed;
+            changed.notify_all();
+            break;
+        }
+        changed.notify_all();
+    }
+}
+
+} // namespace dlexer
@@ -1,12 +1,14 @@
 #include <dlexer/common.hpp>
 #include <cstring>
+#include <fstream>
+#include <iterator>
 
 namespace dlexer {
 
 int findUnit(const char* arr, size_t arrLen, const char* unit, size_t ulen) {
     int unitInd = 0;
-    for(int i = 0; i + ulen <= arrLen; i += ulen, ++unitInd) {
-        if(memcmp(arr + i, unit, ulen) == 0) {
+    for(int i = 0; i + ulen <= arrLen; i += unitLength(arr[i]), ++unitInd) {
+        if(memcmp(arr + i, unit, ulen) == 0 && unitLength(arr[i]) == ulen) {
             return unitInd;
         }
     }
@@ -31,6 +33,29 @@ int extractUnit(char* dst, std::istream& src) {
     return len;
 }
 
+void feedUnits(const char* chunk, size_t len, char* partial, int& partialLen,
+    const std::function<void(const char* unit, int ulen)>& onUnit)
+{
+    size_t i = 0;
+    if(partialLen != 0) {
+        const int ulen = unitLength(partial[0]);
+        while(partialLen < ulen && i < len) { partial[partialLen++] = chunk[i++]; }
+        if(partialLen < ulen) { return; }
+
+        partialLen = 0;
+        onUnit(partial, ulen);
+    }
+
+    const size_t end = i + completeUnitsLength(chunk + i, len - i);
+    while(i < end) {
+        const int ulen = unitLength(chunk[i]);
+        onUnit(chunk + i, ulen);
+        i += ulen;
+    }
+    partialLen = len - end;
+    std::memcpy(partial, chunk + end, partialLen);
+}
+
 int extractUnitStr(char* dst, const char* src) {
     int len = unitLength(src[0]);
     
@@ -65,4 +90,35 @@ int unitLengthLast(const char* last) {
 #endif
     return off + 1;
 }
+
+size_t completeUnitsLength(const char* str, size_t len) {
+    // a unit is at most 4 bytes, so only the last 3 may be incomplete
+    for(size_t back = 1; back <= 3 && back <= len; ++back) {
+        const char c = str[len - back];
+        if((c & 0xc0) == 0x80) { continue; }
+        return unitLength(c) > static_cast<int>(back) ? len - back : len;
+    }
+    return len;
+}
+
+std::string readTemplate(const char* path) {
+    std::ifstream ifs(path);
+    return std::string(
+        (std::istreambuf_iterator<char>(ifs)),
+        (std::istreambuf_iterator<char>())
+    );
+}
+
+std::string escapeAsCString(const char* src, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+    std::string out = "\"";
+    for(size_t i = 0; i < len; ++i) {
+        const unsigned char c = static_cast<unsigned char>(src[i]);
+        out += "\\x";
+        out += hex[c >> 4];
+        out += hex[c & 0xf];
+    }
+    out += '"';
+    return out;
+}
 } // namespace dlexer
@@ -2,7 +2,10 @@
 #define DLEXER_BASIC_H_
 #include <vector>
 #include <string>
+#include <string_view>
+#include <iterator>
 #include <iostream>
+#include <functional>
 
 namespace dlexer {
 
@@ -15,20 +18,130 @@ struct BasicLexer {
         WEAK_STANDALONE
     };
 
+    // include type of units that aren't bounds
+    static const char NOT_BOUND = -1;
+
+    // The getToken() state machine, shared by every way of lexing: each
+    // step of the loop starts with takePrevUnit(), which adds the unit
+    // kept by the previous token to the token, and goes on with
+    // takeUnit() for the next unit. Both return true if the token ends
+    // there. append() adds the last unit to the token, so the same steps
+    // build a string or grow a view.
+    template<typename Append>
+    static bool takePrevUnit(char& includePrevMode, char& justIncludedMode, const Append& append) {
+        justIncludedMode = includePrevMode;
+        if(includePrevMode == RIGHT_INCLUDE) {
+            append();
+            includePrevMode = NO_INCLUDE;
+        } else if(includePrevMode == STANDALONE || includePrevMode == WEAK_STANDALONE) {
+            append();
+            includePrevMode = NO_INCLUDE;
+            return true;
+        }
+        return false;
+    }
+    // type is the include type of the unit or NOT_BOUND; empty is
+    // whether the token has no units yet
+    template<typename Append>
+    static bool takeUnit(char type, bool empty, char& includePrevMode, char justIncludedMode, const Append& append) {
+        switch(type) {
+        case NO_INCLUDE: return !empty;
+        case LEFT_INCLUDE: append(); return true;
+        case RIGHT_INCLUDE: case STANDALONE: {
+            includePrevMode = type;
+            return !empty;
+        }
+        case WEAK_STANDALONE: {
+            includePrevMode = WEAK_STANDALONE;
+            return !empty && justIncludedMode != RIGHT_INCLUDE;
+        }
+        default: append(); return false;
+        }
+    }
+
+    // Push API state: getToken() state between units, the token being
+    // built and a unit split by the end of a chunk
+    struct PushState {
+        std::string out;
+        char unit[4] = {0};
+        char partial[4] = {0};
+        int partialLen = 0;
+        char includePrevMode = NO_INCLUDE;
+        char justIncludedMode = NO_INCLUDE;
+    };
+    using Sink = std::function<void(const std::string& token)>;
+
     std::vector<char> bounds;
     std::vector<IncludeType> incType;
     char unit[4] = {0};
     char includePrevMode = NO_INCLUDE;
+    PushState pushState;
 
     BasicLexer(const std::string& pat);
     BasicLexer(std::vector<char>&& bounds, std::vector<IncludeType>&& incType);
     
     void reprogram(const std::string& pat);
     void endCurTokenList();
+    // include type of the first bound equal to the unit or NOT_BOUND
+    char includeTypeOf(const char* unit, int ulen) const;
     bool getToken(std::string& out, std::istream& in);
     bool getToken(std::string& out, std::istream& in, char* unit, char& includePrevMode) const;
 
-    void writeAsCppProgram(std::ofstream& out) const; // TODO
+    // Push API: chunks may split tokens and units anywhere (see
+    // feedUnits()). sink gets the same tokens as getToken() would, each
+    // as soon as the unit ending it is fed; finish() flushes the last one
+    // and resets the state.
+    void feed(const char* chunk, size_t len, const Sink& sink);
+    void finish(const Sink& sink);
+    void feed(const char* chunk, size_t len, PushState& state, const Sink& sink) const;
+    void finish(PushState& state, const Sink& sink) const;
+
+    // Input iterator over tokens of a string in memory. A token is a view
+    // of the string, as getToken() builds it of adjacent units; it's valid
+    // while the string is.
+    class TokenIterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = std::string_view;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const std::string_view*;
+        using reference = const std::string_view&;
+
+        // end of any range
+        TokenIterator() = default;
+        TokenIterator(const BasicLexer& lexer, std::string_view str);
+
+        reference operator*() const { return token; }
+        pointer operator->() const { return &token; }
+        TokenIterator& operator++();
+        TokenIterator operator++(int) {
+            TokenIterator res = *this;
+            ++*this;
+            return res;
+        }
+        bool operator==(const TokenIterator& r) const { return lexer == r.lexer && pos == r.pos; }
+        bool operator!=(const TokenIterator& r) const { return !(*this == r); }
+
+    private:
+        // nullptr at the end
+        const BasicLexer* lexer = nullptr;
+        std::string_view str;
+        size_t pos = 0;
+        // the last unit and getToken() includePrevMode for it
+        size_t unitPos = 0;
+        int ulen = 0;
+        char includePrevMode = NO_INCLUDE;
+        std::string_view token;
+    };
+    struct TokenRange {
+        TokenIterator first;
+        TokenIterator begin() const { return first; }
+        TokenIterator end() const { return TokenIterator(); }
+    };
+    // str must outlive the range
+    TokenRange tokens(std::string_view str) const;
+
+    void writeAsCppProgram(std::ofstream& out) const;
 };
 
 } // namespace dlexer
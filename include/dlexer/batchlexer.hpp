@@ -0,0 +1,114 @@
+#ifndef DLEXER_BATCHLEXER_H_
+#define DLEXER_BATCHLEXER_H_
+#include <dlexer/regex.hpp>
+#include <dlexer/tokencache.hpp>
+#include <string_view>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace dlexer {
+
+// Tokens of many records with their groups in one flat array, filled by
+// BatchLexer::getTokens(). Token k of record r is at index first[r] + k;
+// its span is spans[index * stride] and its groups follow it, laid out as
+// in RegexBatch. Spans are offsets in their record.
+struct RecordBatch {
+    // 1 + number of groups
+    size_t stride = 1;
+    // per record, where its text starts
+    std::vector<const char*> str;
+    // per record and one past the last, index of its first token
+    std::vector<size_t> first;
+    std::vector<RegexBatch::Span> spans;
+    // per span, whether it matched
+    std::vector<uint8_t> matched;
+
+    size_t records() const { return str.size(); }
+    size_t tokenCount(size_t r) const { return first[r + 1] - first[r]; }
+    std::string_view token(size_t r, size_t k) const { return view(r, spans[(first[r] + k) * stride]); }
+    std::string_view group(size_t r, size_t k, size_t g) const {
+        return view(r, spans[(first[r] + k) * stride + 1 + g]);
+    }
+    bool groupMatched(size_t r, size_t k, size_t g) const { return matched[(first[r] + k) * stride + 1 + g]; }
+
+    std::string_view view(size_t r, const RegexBatch::Span& s) const {
+        return std::string_view(str[r] + s.start, s.end - s.start);
+    }
+};
+
+// Lexes batches of records on a pool of threads sharing one compiled
+// lexer. Each thread has its own RegexData, reused from record to record
+// and batch to batch, so a record costs a rewind rather than a context.
+// Records are taken in chunks, which are lexed into buffers of their own
+// and copied into the RecordBatch in order, so the result doesn't depend
+// on the number of threads.
+class BatchLexer {
+public:
+    // records per unit of work
+    static const size_t ChunkRecords = 64;
+
+    // lexer must outlive the BatchLexer; threads is the number of threads
+    // lexing including the calling one, 0 is one per core
+    BatchLexer(const RegexLexer& lexer, unsigned threads = 0);
+    ~BatchLexer();
+    BatchLexer(const BatchLexer&) = delete;
+    BatchLexer& operator=(const BatchLexer&) = delete;
+
+    unsigned threadCount() const { return static_cast<unsigned>(contexts.size()); }
+
+    // Records found in cache take their tokens from it, others are lexed
+    // and added to it. cache isn't owned and must be used with this
+    // lexer only; nullptr detaches it.
+    void setCache(TokenCache* cache) { this->cache = cache; }
+
+    // replaces out with tokens of every record, as getToken() gives them
+    // over each record alone; records must fit in 4 GiB each
+    void getTokens(const std::vector<std::string_view>& records, RecordBatch& out);
+
+    // Line mode: every line of text is a record, lexed on its own from
+    // the line start, so ^ and $ see only its bounds and no token spans
+    // lines. Record r of out is line r, without its '\n'; text ending
+    // with '\n' has no empty last line.
+    void getLineTokens(std::string_view text, RecordBatch& out);
+    // replaces lines with the lines of text as getLineTokens() takes them
+    static void splitLines(std::string_view text, std::vector<std::string_view>& lines);
+
+private:
+    struct Chunk {
+        std::vector<RegexBatch::Span> spans;
+        std::vector<uint8_t> matched;
+        // tokens per record
+        std::vector<size_t> counts;
+    };
+
+    const RegexLexer& lexer;
+    // per thread, the last one is the caller's
+    std::vector<RegexData> contexts;
+    std::vector<Chunk> chunks;
+    std::vector<std::thread> workers;
+    TokenCache* cache = nullptr;
+    // getLineTokens() records
+    std::vector<std::string_view> lines;
+
+    // the batch being lexed
+    const std::vector<std::string_view>* records = nullptr;
+    std::atomic<size_t> nextChunk{0};
+    // batches started, so that a worker takes each one once
+    uint64_t generation = 0;
+    unsigned busy = 0;
+    bool stopping = false;
+    std::mutex mutex;
+    std::condition_variable started;
+    std::condition_variable done;
+
+    void workerLoop(size_t ctx);
+    // lexes chunks until none are left
+    void work(RegexData& data);
+    void lexChunk(size_t c, RegexData& data);
+};
+
+} // namespace dlexer
+#endif // DLEXER_BATCHLEXER_H_
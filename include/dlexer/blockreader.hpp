@@ -0,0 +1,101 @@
+#ifndef DLEXER_BLOCKREADER_H_
+#define DLEXER_BLOCKREADER_H_
+#include <string>
+#include <memory>
+#include <vector>
+#include <istream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace dlexer {
+
+// Reads a stream on its own thread into a ring of blocks, so that the
+// next blocks are read while the lexer works on the current one. With the
+// default two blocks it's double buffering. Blocks split tokens anywhere,
+// feedAll() passes them to the push API of a lexer, which carries them.
+// Compressed streams are decompressed on the reader thread, so reading
+// and decompression take one core and lexing another.
+class BlockReader {
+public:
+    static const size_t DefaultBlockSize = 1 << 16;
+    static const size_t DefaultBlockCount = 2;
+
+    enum Compression {
+        NONE,
+        // gzip members, one after another as `cat a.gz b.gz` gives them;
+        // zlib streams are accepted too. Needs zlib.
+        GZIP,
+        // zstd frames, needs libzstd
+        ZSTD,
+        // chosen by the magic bytes at the start of the stream
+        DETECT,
+    };
+    // whether the library was built with the decompressor
+    static bool supports(Compression c);
+
+    // in must outlive the reader and isn't touched by other threads
+    // until it's destroyed; an unsupported compression fails right away
+    BlockReader(std::istream& in, size_t blockSize = DefaultBlockSize, size_t blockCount = DefaultBlockCount,
+        Compression compression = NONE);
+    ~BlockReader();
+    BlockReader(const BlockReader&) = delete;
+    BlockReader& operator=(const BlockReader&) = delete;
+
+    static std::unique_ptr<BlockReader> fromFile(const std::string& path, std::string* error = nullptr,
+        size_t blockSize = DefaultBlockSize, size_t blockCount = DefaultBlockCount,
+        Compression compression = DETECT);
+
+    // waits for the next block, which stays valid until the next call;
+    // returns false at the end of the stream
+    bool next(const char** data, size_t* len);
+    // whether the stream ended with a read error or corrupted or
+    // truncated compressed data rather than at its end
+    bool failed() const;
+
+    // feeds every block to lexer.feed() and calls lexer.finish()
+    template<typename Lexer, typename Sink>
+    void feedAll(Lexer& lexer, const Sink& sink) {
+        const char* data;
+        size_t len;
+        while(next(&data, &len)) { lexer.feed(data, len, sink); }
+        lexer.finish(sink);
+    }
+    template<typename Lexer, typename Sink>
+    void feedAll(const Lexer& lexer, typename Lexer::PushState& state, const Sink& sink) {
+        const char* data;
+        size_t len;
+        while(next(&data, &len)) { lexer.feed(data, len, state, sink); }
+        lexer.finish(state, sink);
+    }
+
+    // plain reader or decompressor, see blockreader.cpp
+    struct Source;
+
+private:
+    struct Block {
+        std::unique_ptr<char[]> data;
+        size_t len = 0;
+    };
+
+    std::unique_ptr<std::istream> owned;
+    std::unique_ptr<Source> source;
+    const size_t blockSize;
+    // blocks [head, head + filled) are read, head is given to the consumer
+    std::vector<Block> ring;
+    size_t head = 0;
+    size_t filled = 0;
+    bool holding = false;
+    bool ended = false;
+    bool readFailed = false;
+    bool stopping = false;
+    mutable std::mutex mutex;
+    std::condition_variable changed;
+    std::thread thread;
+
+    BlockReader(std::unique_ptr<std::istream> owned, size_t blockSize, size_t blockCount, Compression compression);
+    void readLoop();
+};
+
+} // namespace dlexer
+#endif // DLEXER_BLOCKREADER_H_
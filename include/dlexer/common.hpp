@@ -1,5 +1,6 @@
 #include <string>
 #include <iostream>
+#include <functional>
 
 namespace dlexer {
 
@@ -10,5 +11,18 @@ int extractUnit(char* dst, std::istream& src);
 int extractUnitStr(char* dst, const char* src);
 int unitLength(char first);
 int unitLengthLast(const char* last);
+// length of the longest prefix of whole units, the rest is a unit split
+// by the end of a chunk
+size_t completeUnitsLength(const char* str, size_t len);
+// Push API chunking: calls onUnit for each whole unit of the chunk. A
+// unit split by the end of the chunk is kept in partial until the next
+// chunks complete it, one split by the end of input is never passed.
+void feedUnits(const char* chunk, size_t len, char* partial, int& partialLen,
+    const std::function<void(const char* unit, int ulen)>& onUnit);
+
+// reads whole file of a code generation template
+std::string readTemplate(const char* path);
+// returns bytes as a C string literal made of \x escapes, including quotes
+std::string escapeAsCString(const char* src, size_t len);
 
 } // namespace dlexer
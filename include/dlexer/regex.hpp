@@ -2,9 +2,16 @@
 #define DLEXER_REGEX_H_
 #include <vector>
 #include <string>
+#include <string_view>
+#include <iterator>
+#include <array>
 #include <memory>
 #include <utility>
 #include <iostream>
+#include <cstdint>
+#include <chrono>
+#include <functional>
+#include <unordered_map>
 
 namespace dlexer {
 
@@ -32,6 +39,8 @@ struct Node {
     bool needsUnit;
     int pres;
     bool skipSpecials;
+    // byte offset of the pattern symbol the node was created for, -1 if none
+    int patternPos = -1;
 
     Node(bool skip, bool usage, int pres)
         : skipSpecials(skip)
@@ -39,13 +48,9 @@ struct Node {
         , pres(pres)
         {}
     virtual ~Node() {}
-    virtual int satisfies(RegexData& data) const = 0;
-
-    // TODO: has side effects only for GroupNode;
-    //       think how to remove this method from other nodes
-    //       and revert without some kinds of RTTI
-    virtual void revert(RegexData& data) const = 0;
 
+    // matching semantics live in the compiled Program (see ProgNode),
+    // nodes only build the graph
     virtual void acceptVisitor(dtl::INodeVisitor& visitor) = 0;
 
     // returns next child adapter
@@ -74,8 +79,6 @@ struct NodeCRTP: Node {
     NodeCRTP(bool skip, bool needsUnit): Node(skip, needsUnit, Derived::Presedence) {}
     NodeCRTP(bool skip): NodeCRTP(skip, Derived::UnitUsage) {}
 
-    void revert(RegexData& data) const override {};
-
     void acceptVisitor(dtl::INodeVisitor& visitor) override {
         Derived& castedSelf = *static_cast<Derived*>(this);
         visitor.visit(castedSelf);
@@ -91,7 +94,6 @@ struct UnitNode: NodeCRTP<UnitNode> {
 
     UnitNode(const char* unitPtr, int ulen);
 
-    int satisfies(RegexData& data) const override;
     void adaptChild(Children_t& stack, Node& node, int at) override;
 };
 
@@ -100,7 +102,6 @@ struct StartNode: NodeCRTP<StartNode> {
     static const bool SkipSpecials = false;
     static const bool UnitUsage = false;
 
-    int satisfies(RegexData& data) const override;
     void adaptChild(Children_t& stack, Node& node, int at) override;
 };
 
@@ -119,8 +120,6 @@ struct GroupNode: NodeCRTP<GroupNode> {
 
     bool isEnd() const;
 
-    int satisfies(RegexData& data) const override;
-    void revert(RegexData& data) const override;
     void adaptChild(Children_t& stack, Node& node, int at) override;
 
     void lowerPresedence();
@@ -142,7 +141,6 @@ struct OrNode: NodeCRTP<OrNode> {
     OrNode(bool neg);
     OrNode();
 
-    int satisfies(RegexData& data) const override;
     void adaptChild(Children_t& stack, Node& node, int at) override;
 
 private:
@@ -163,7 +161,6 @@ struct RepeatNode: NodeCRTP<RepeatNode> {
 
     RepeatNode(Mode mode);
 
-    int satisfies(RegexData& data) const override;
     void adaptChild(Children_t& stack, Node& node, int at) override;
 };
 
@@ -174,7 +171,6 @@ struct EndNode: NodeCRTP<EndNode> {
 
     EndNode();
 
-    int satisfies(RegexData& data) const override;
     void adaptChild(Children_t& stack, Node& node, int at) override;
 };
 
@@ -185,7 +181,6 @@ struct AtStartNode: NodeCRTP<AtStartNode> {
 
     AtStartNode();
 
-    int satisfies(RegexData& data) const override;
     void adaptChild(Children_t& stack, Node& node, int at) override;
 };
 
@@ -196,7 +191,6 @@ struct AtEndNode: NodeCRTP<AtEndNode> {
 
     AtEndNode();
 
-    int satisfies(RegexData& data) const override;
     void adaptChild(Children_t& stack, Node& node, int at) override;
 };
 
@@ -214,7 +208,6 @@ struct RangeNode: NodeCRTP<RangeNode> {
     RangeNode(const char* start, int startlen);
     RangeNode(const char* start, const char* end, int startlen, int endlen);
 
-    int satisfies(RegexData& data) const override;
     void adaptChild(Children_t& stack, Node& node, int at) override;
 };
 
@@ -225,13 +218,126 @@ struct FailNode: NodeCRTP<FailNode> {
 
     FailNode();
 
-    int satisfies(RegexData& data) const override;
     void adaptChild(Children_t& stack, Node& node, int at) override;
 };
 
+enum ProgKind: uint8_t {
+    PROG_UNIT,
+    PROG_START,
+    PROG_GROUP,
+    PROG_OR,
+    PROG_REPEAT,
+    PROG_END,
+    PROG_AT_START,
+    PROG_AT_END,
+    PROG_RANGE,
+    PROG_FAIL,
+};
+
+enum ProgFlag: uint8_t {
+    PROG_NEEDS_UNIT = 1,
+    PROG_IS_END = 2,
+    PROG_CAPTURE = 4,
+    PROG_NEGATIVE = 8,
+    PROG_LAZY = 16,
+};
+
+// Node of the graph flattened into an array: children are indices into
+// Program::children, so the whole program is position independent and
+// can be used right from a mapped file.
+struct ProgNode {
+    uint8_t kind;
+    uint8_t flags;
+    // length of unit or range bounds
+    uint8_t ulen;
+    // RepeatNode::Mode
+    uint8_t mode;
+    int32_t groupId;
+    uint32_t firstChild;
+    uint32_t childCount;
+    // unit or range start
+    unsigned char a[4];
+    // range end
+    unsigned char b[4];
+    // Node::patternPos
+    int32_t patternPos;
+};
+
+static const char ProgMagic[8] = { 'D', 'L', 'E', 'X', 'R', 'E', 'G', '\0' };
+static const uint32_t ProgVersion = 5;
+static const uint32_t ProgEndianTag = 0x01020304;
+
+// Layout of a compiled image: header, pattern, nodes, children, then the
+// BitProgram tables if the program fits it. Every offset is from the
+// image start and aligned to 8 bytes. Results of the analysis are kept
+// in the header, so loading an image only checks its bounds.
+struct ProgHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t endianTag;
+    uint32_t size;
+    uint32_t groupCount;
+    uint32_t patternOffset;
+    uint32_t patternLength;
+    uint32_t nodesOffset;
+    uint32_t nodeCount;
+    uint32_t childrenOffset;
+    uint32_t childCount;
+    // RegexLexer::Flags the program was compiled with
+    uint32_t flags;
+    // RegexAnalysis of the program
+    uint32_t features;
+    int32_t ambiguousPos;
+    // RegexAnalysis::Engine
+    uint32_t engine;
+    // bit set of first bytes of non-empty matches; a start position
+    // whose byte isn't in the set can't match
+    uint8_t firstBytes[32];
+    // if true, firstBytes can't be used (pattern may match empty string)
+    uint8_t anyFirstByte;
+    uint8_t padding[7];
+    // RegexAnalysis::stackDepth, maxTokenLength and maxLookahead, with
+    // UINT64_MAX for Unbounded
+    uint64_t stackDepth;
+    uint64_t maxTokenLength;
+    uint64_t maxLookahead;
+    // BitProgram tables; bitStateCount is 0 if the program doesn't use them
+    uint32_t bitStatesOffset;
+    uint32_t bitStateCount;
+    uint32_t byteClassOffset;
+    uint32_t classStartsOffset;
+    uint32_t classMasksOffset;
+    uint32_t classCount;
+    uint32_t opBoundsOffset;
+    uint32_t opBoundCount;
+    uint32_t groupOpsOffset;
+    uint32_t groupOpCount;
+};
+
+// Non-owning view of a compiled image; node 0 is the start node
+struct Program {
+    const ProgHeader* header = nullptr;
+    const ProgNode* nodes = nullptr;
+    const uint32_t* children = nullptr;
+
+    const ProgNode& child(const ProgNode& n, int at) const {
+        return nodes[children[n.firstChild + at]];
+    }
+    bool canStartWith(char c) const {
+        const unsigned char u = static_cast<unsigned char>(c);
+        return header->anyFirstByte || (header->firstBytes[u >> 3] & (1 << (u & 7)));
+    }
+};
+
+// returns index of the first child to process or -1 if not satisfied;
+// nodes needing unit check data.unit
+int satisfies(const Program& prog, const ProgNode& n, RegexData& data);
+
+// Backtrack stack entry: index in Program::children of the next child
+// to try. The node of the entry is the child the entry below it was
+// trying, children[below.nextChild - 1], or the StartNode for the first.
 struct NodeMem {
-    dtl::Node* node;
-    int firstUnprocessedChild;
+    uint32_t nextChild;
 };
 
 enum OrGroupMode_t {
@@ -239,6 +345,185 @@ enum OrGroupMode_t {
     INSIDE,
     INSIDE_EXC,
 };
+
+// thread list of the NFA engine; threads are kept in priority order
+struct NfaList {
+    std::vector<uint32_t> nodes;
+    // per thread: start position, then start and end of every group
+    std::vector<int> caps;
+};
+
+struct NfaState {
+    NfaList lists[2];
+    // generation in which a node was added to the current list
+    std::vector<uint32_t> mark;
+    uint32_t gen = 0;
+    std::vector<int> scratch;
+    // captures of the thread that matched
+    std::vector<int> caps;
+};
+
+// Glushkov automaton of a program: its states are the consuming nodes,
+// at most 64, so a set of states is a 64-bit mask. Units are split into
+// classes that every consuming node either accepts or rejects as a whole,
+// and a transition is an AND of the follow mask with the class mask.
+//
+// As the automaton is deterministic, the backtracker would walk epsilon
+// nodes of a state in the same order every time, so its capture group
+// writes and reverts are replayed as precomputed GroupOps.
+//
+// Non-owning view of the tables in a compiled image, see BitTables.
+struct BitProgram {
+    // field is 2 * groupId for group start and 2 * groupId + 1 for end
+    struct GroupOp {
+        uint8_t field;
+        // 1 sets the field to the current position, 0 to -1
+        uint8_t set;
+    };
+
+    struct State {
+        uint64_t follow;
+        // follow states the backtracker tries before ending the match
+        uint64_t beforeEnd;
+        // fields of all capture groups among epsilon nodes of the state
+        uint64_t touched;
+        // First of the opBounds ranges of the state; with n follow states,
+        // ranges [0, n) are for taking i-th follow state, [n, 2n) and
+        // [2n, 3n) for ending the match here after the i-th one failed
+        // (before and after its fields are reverted) and 3n for ending
+        // the match when no follow state is taken.
+        uint32_t ops;
+        uint8_t final;
+        uint8_t padding[3];
+    };
+
+    // consuming states, then the start state
+    const State* states = nullptr;
+    uint32_t stateCount = 0;
+    // 256 entries
+    const uint16_t* byteClass = nullptr;
+    // first unit key of every class, for units longer than a byte
+    const uint64_t* classStarts = nullptr;
+    const uint64_t* classMasks = nullptr;
+    uint32_t classCount = 0;
+    const uint32_t* opBounds = nullptr;
+    const GroupOp* groupOps = nullptr;
+
+    int classOf(const char* unit, int ulen) const;
+    int start() const { return stateCount - 1; }
+};
+
+// BitProgram tables as RegexLexer::compileProgram() builds them before
+// writing them into the image
+struct BitTables {
+    std::vector<BitProgram::State> states;
+    uint16_t byteClass[256];
+    std::vector<uint64_t> classStarts;
+    std::vector<uint64_t> classMasks;
+    std::vector<uint32_t> opBounds;
+    std::vector<BitProgram::GroupOp> groupOps;
+
+    // returns false if the program doesn't fit: it has more than 64
+    // consuming nodes or 32 capture groups, anchors or epsilon loops,
+    // or its automaton isn't deterministic
+    bool build(const Program& prog);
+};
+} // namespace dtl
+
+// Counters of the RegexLexer engines. They are filled only when dlexer
+// is built with DLEXER_STATS, otherwise RegexData::getStats() returns
+// zeros. Engines other than the backtracker give back no units and use
+// no stack, so backtracks and maxStackDepth stay 0 for them.
+struct RegexStats {
+#ifdef DLEXER_STATS
+    static constexpr bool enabled = true;
+#else
+    static constexpr bool enabled = false;
+#endif
+
+    struct Counters {
+        uint64_t steps;         // nodes tried
+        uint64_t backtracks;    // units given back by returnUnit()
+        uint64_t unitsFetched;
+        uint64_t failedStarts;  // start positions where the pattern can't match
+        uint64_t maxStackDepth;
+    };
+
+    Counters token;  // of the last getToken() call
+    Counters total;
+    uint64_t tokens; // successful getToken() calls
+};
+
+// Counters of the RegexLexer matcher per program node, indexed as
+// dtl::Program::nodes. Filled only when dlexer is built with DLEXER_STATS
+// and the profile is attached with RegexData::setProfile(). Programs of
+// the bit-parallel engines have no nodes to count, so a RegexData with a
+// profile runs them on the backtracker.
+// See RegexLexer::profileReport() and writeProfileDot().
+struct RegexProfile {
+    struct NodeCounters {
+        uint64_t steps;      // times the node was tried
+        uint64_t fails;      // times it wasn't satisfied
+        uint64_t backtracks; // units given back on its behalf
+    };
+
+    std::vector<NodeCounters> nodes;
+
+    void clear() { nodes.clear(); }
+};
+
+// Result of the analysis run on every compiled program
+struct RegexAnalysis {
+    enum Feature: uint32_t {
+        LAZY = 1,
+        CAPTURES = 2,
+        ANCHORS = 4,
+        NEGATED_CLASSES = 8,
+        // the same input may be matched by two different paths around
+        // a loop, as in (a+)+ or (a|a)*, so backtracking may take
+        // exponential time
+        EXPONENTIAL = 16,
+        // pattern is too big to look for EXPONENTIAL
+        UNANALYZED = 32,
+    };
+    enum Engine {
+        BACKTRACK,
+        // Pike VM over the same program: linear in input, but repeated
+        // capture groups keep their last iteration rather than following
+        // backtracker reverts
+        NFA,
+        // dtl::BitProgram; used when the program fits it
+        BITPARALLEL,
+        // BITPARALLEL with capture groups, one pass without backtracking
+        ONEPASS,
+    };
+
+    uint32_t features = 0;
+    // offset of a pattern symbol on the ambiguous loop, -1 if none
+    int ambiguousPos = -1;
+    // backtrack stack entries a token may need, 0 if the program has
+    // loops and it depends on the token length
+    size_t stackDepth = 0;
+    // For programs without loops: the longest token and how many units
+    // after its end a call may look at to find it. A stream window of
+    // maxTokenLength + maxLookahead units decides a token, so
+    // RegexLexer::feed() keeps no more than that plus two units.
+    // Unbounded if the program has loops.
+    static const size_t Unbounded = SIZE_MAX;
+    size_t maxTokenLength = Unbounded;
+    size_t maxLookahead = Unbounded;
+    Engine engine = BACKTRACK;
+
+    bool has(Feature f) const { return features & f; }
+};
+
+namespace dtl {
+// fills features and ambiguousPos
+RegexAnalysis analyzeProgram(const Program& prog);
+// see RegexAnalysis::stackDepth
+size_t stackDepth(const Program& prog);
+// fills maxTokenLength and maxLookahead
+void lengthBounds(const Program& prog, RegexAnalysis& res);
 } // namespace dtl
 
 struct RegexData {
@@ -254,6 +539,18 @@ struct RegexData {
 
     std::vector<dtl::NodeMem> stack;
     std::vector<Group> groups;
+    // RegexLexer::MEMOIZE state: visited bits and words to clear
+    std::vector<uint64_t> visited;
+    std::vector<uint32_t> visitedDirty;
+    // group fields reset per stack frame and per failed state, so that
+    // MEMOIZE groups are the backtracker's
+    std::vector<uint64_t> memoFrames;
+    std::vector<uint64_t> memoEffects;
+    std::unordered_map<uint64_t, size_t> memoEffectAt;
+    // RegexAnalysis::NFA engine state
+    dtl::NfaState nfa;
+    // RegexAnalysis::ONEPASS state: groups at the end of the longest match
+    std::vector<Group> onePassGroups;
     const char* str;
     size_t strLen;
     char unit[4];
@@ -268,13 +565,104 @@ struct RegexData {
         LINE_AT_PAST_EOF,
     } at = LINE_AT_START;
 
+    // When set, getToken() leaves groups empty and finds the token with
+    // captures off; RegexLexer::getGroups() fills them on demand.
+    bool lazyGroups = false;
+    // lazyGroups state: where the last getToken() call and its match
+    // started, matchStart is -1 if groups are up to date
+    int callStart = 0;
+    decltype(at) callAt = LINE_AT_START;
+    int matchStart = -1;
+
+    // Set by getToken() when an attempt starting at hitEndStart looked
+    // past the end of str, so that more input may change the result;
+    // the earliest such attempt is kept. RegexLexer::feed() waits for
+    // more input instead of reporting such a token.
+    bool hitEnd = false;
+    int hitEndStart = 0;
+
+    // Limits of a single RegexLexer::getToken() call, 0 is no limit.
+    // stackLimit bounds the backtrack stack, in entries of 4 bytes.
+    // When one is exceeded, getToken() returns false, sets status and
+    // rewinds to the start position it was trying, so the call may be
+    // repeated with other limits or the position skipped by extractUnit().
+    uint64_t stepBudget = 0;
+    std::chrono::nanoseconds timeBudget{0};
+    size_t stackLimit = 0;
+    enum Status {
+        OK,
+        STEP_BUDGET_EXCEEDED,
+        DEADLINE_EXCEEDED,
+        STACK_LIMIT_EXCEEDED,
+    } status = OK;
+#ifdef DLEXER_STATS
+    RegexStats stats = {};
+    RegexProfile* profile = nullptr;
+#endif
+
+    RegexStats getStats() const;
+    void resetStats();
+    // profile isn't owned, nullptr detaches it
+    void setProfile(RegexProfile* profile);
+
     bool extractUnit();
     // returns number of bytes of reverted unit
     int returnUnit();
+    // reports the match [startPos, pos); an empty one also skips a unit,
+    // so that the next call makes progress
+    void finishMatch(const char** start, const char** end);
+    // moves to pos in the state extractUnit() would leave there
+    void rewindTo(int pos);
+    void markHitEnd(int start);
     void updateAt();
 
     // WARNING: doesn't check for eof
     bool isCurOrNextNewLine() const;
+
+    // text of a group of str, empty view with nullptr data if the group
+    // didn't participate
+    std::string_view view(const Group& g) const {
+        if(g.start == -1 || g.end == -1) { return std::string_view(); }
+        return std::string_view(str + g.start, g.end - g.start);
+    }
+};
+
+// A token and views of its first N groups, filled by RegexLexer::getMatch()
+// without allocation. A group that didn't participate is an empty view
+// with nullptr data.
+template<size_t N>
+struct RegexMatch {
+    std::string_view text;
+    std::array<std::string_view, N> groups;
+    // groups of the pattern, may be more than N
+    size_t groupCount = 0;
+
+    bool matched(size_t i) const { return groups[i].data() != nullptr; }
+};
+
+// Tokens with all their groups in one flat array, filled by
+// RegexLexer::getTokens(): token k is spans[k * stride] and its groups
+// follow it. A group that didn't participate is an empty span at the
+// token start with matched clear, so every span may be sliced as is.
+struct RegexBatch {
+    struct Span {
+        uint32_t start;
+        uint32_t end;
+    };
+
+    const char* str = nullptr;
+    // 1 + number of groups
+    size_t stride = 1;
+    std::vector<Span> spans;
+    // per span, whether it matched
+    std::vector<uint8_t> matched;
+
+    size_t size() const { return spans.size() / stride; }
+    std::string_view token(size_t k) const { return view(spans[k * stride]); }
+    std::string_view group(size_t k, size_t g) const { return view(spans[k * stride + 1 + g]); }
+    bool groupMatched(size_t k, size_t g) const { return matched[k * stride + 1 + g]; }
+
+    std::string_view view(const Span& s) const { return std::string_view(str + s.start, s.end - s.start); }
 };
 
 class RegexLexer {
@@ -282,26 +670,196 @@ public:
     std::string* err = nullptr;
     RegexData data;
 
-    RegexLexer(const std::string& pat);
+    // Flags affecting compilation; they are part of the compiled image
+    // and of RegexCache keys
+    enum Flags: unsigned {
+        NO_FLAGS = 0,
+        // getToken() remembers (node, position) states proven to fail and
+        // doesn't enter them again, like RE2's BitState. It bounds a call
+        // by O(nodes * input) steps at the cost of a visited bit set.
+        MEMOIZE = 1,
+        // Engine selection: by default RegexAnalysis::NFA is used for
+        // EXPONENTIAL and UNANALYZED patterns, BITPARALLEL or ONEPASS for
+        // programs fitting them and backtracking for others; MEMOIZE keeps
+        // the backtracker. These force one of the engines.
+        NFA = 2,
+        BACKTRACK = 4,
+    };
+
+    // visited bit set limit; positions further than MaxMemoBits / nodes
+    // from the call start aren't memoized
+    static const size_t MaxMemoBits = 1 << 23;
+    // backtrack stack entries reserved for programs with loops
+    static const size_t DefaultStackReserve = 256;
+
+    // if RegexCache::global() is enabled, a pattern compiled before
+    // is taken from it instead of being parsed again
+    RegexLexer(const std::string& pat, unsigned flags = NO_FLAGS);
+
+    // Compiled image: the program produced by parsePattern() in a versioned
+    // position-independent format. Loading it maps the file and uses it
+    // in place, without parsing the pattern again.
+    bool writeImage(const std::string& path) const;
+    std::string getImage() const;
+    static std::unique_ptr<RegexLexer> fromImageFile(const std::string& path, std::string* error = nullptr);
+    static std::unique_ptr<RegexLexer> fromImage(std::shared_ptr<const char> image, size_t size, std::string* error = nullptr);
+
+    const std::string& getPattern() const;
+    int getGroupCount() const;
+    unsigned getFlags() const;
+    const RegexAnalysis& getAnalysis() const;
 
     bool getToken(std::string& out, std::istream& in);
     bool getToken(std::string& out, const std::string& in);
     bool getToken(std::string& out, RegexData& data) const;
     bool getToken(const char** start, const char** end, RegexData& data) const;
+    // groups of the last token; with RegexData::lazyGroups, the first
+    // call after a token matches it again to fill them
+    const std::vector<RegexData::Group>& getGroups(RegexData& data) const;
+    // appends spans of the last token, from start to end, and of its
+    // groups as RegexBatch lays them out
+    void appendSpans(const char* start, const char* end, RegexData& data,
+        std::vector<RegexBatch::Span>& spans, std::vector<uint8_t>& matched) const;
+
+    // getToken() with views of the groups; lazyGroups are filled
+    template<size_t N>
+    bool getMatch(RegexMatch<N>& m, RegexData& data) const {
+        const char* start;
+        const char* end;
+        if(!getToken(&start, &end, data)) { return false; }
+
+        const std::vector<RegexData::Group>& groups = getGroups(data);
+        m.text = std::string_view(start, end - start);
+        m.groupCount = groups.size();
+        for(size_t i = 0; i < N; ++i) {
+            m.groups[i] = i < groups.size() ? data.view(groups[i]) : std::string_view();
+        }
+        return true;
+    }
+    // Replaces batch with up to maxTokens next tokens of data, returns
+    // their number; fewer than maxTokens means the end or an exceeded
+    // limit of data
+    size_t getTokens(RegexBatch& batch, RegexData& data, size_t maxTokens = SIZE_MAX) const;
+
+    class TokenRange;
+    struct Token {
+        std::string_view text;
+        // groups of the token, offsets are in the string of the range
+        const std::vector<RegexData::Group>& groups() const { return lexer->getGroups(*data); }
+        // text of a group, empty view with nullptr data if it didn't match
+        std::string_view group(int i) const;
+
+        const RegexLexer* lexer;
+        RegexData* data;
+    };
+    // Input iterator over tokens of TokenRange; token views are valid
+    // while the string is, groups until the iterator is incremented
+    class TokenIterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = Token;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Token*;
+        using reference = const Token&;
+
+        // end of any range
+        TokenIterator() = default;
+        explicit TokenIterator(TokenRange& range);
+
+        reference operator*() const { return token; }
+        pointer operator->() const { return &token; }
+        TokenIterator& operator++();
+        // the token is overwritten, so it returns nothing to dereference
+        void operator++(int) { ++*this; }
+        bool operator==(const TokenIterator& r) const {
+            return range == r.range && token.text.data() == r.token.text.data() && token.text.size() == r.token.text.size();
+        }
+        bool operator!=(const TokenIterator& r) const { return !(*this == r); }
+
+    private:
+        // nullptr at the end
+        TokenRange* range = nullptr;
+        Token token = { std::string_view(), nullptr, nullptr };
+    };
+    // Tokens of a string in memory, found by getToken() without copying.
+    // The range is single pass; iteration stops early if a limit of data
+    // is exceeded, data.status tells it.
+    class TokenRange {
+    public:
+        // limits and lazyGroups may be set before begin()
+        RegexData data;
+
+        // str must outlive the range
+        TokenRange(const RegexLexer& lexer, std::string_view str);
+        TokenIterator begin() { return TokenIterator(*this); }
+        TokenIterator end() const { return TokenIterator(); }
+
+    private:
+        friend class TokenIterator;
+        const RegexLexer* lexer;
+    };
+    TokenRange tokens(std::string_view str) const;
+
+    // Push API state: the input not consumed yet, after one unit kept for
+    // line anchors, and the position getToken() resumes from
+    struct PushState {
+        std::string buf;
+        size_t from = 0;
+        RegexData data;
+    } pushState;
+    // start and end point into the buffer and are valid only during the
+    // call; groups are taken from data with getGroups()
+    using Sink = std::function<void(const char* start, const char* end, RegexData& data)>;
+
+    // Push API: chunks may split tokens and units anywhere. A token is
+    // given to sink once no match attempt up to it looked past the fed
+    // input, so it's the same token getToken() finds in the whole input.
+    // Limits of state.data apply to each attempt; one exceeding them
+    // skips a unit. finish() reports the rest and resets the state.
+    void feed(const char* chunk, size_t len, const Sink& sink);
+    void finish(const Sink& sink);
+    void feed(const char* chunk, size_t len, PushState& state, const Sink& sink) const;
+    void finish(PushState& state, const Sink& sink) const;
 
     void reprogram(const std::string& pat);
 
+    // Annotated pattern: every node that was tried, hottest first, with
+    // a caret under the pattern symbol it comes from
+    std::string profileReport(const RegexProfile& profile) const;
+    // program graph with nodes labeled by counters and colored by steps
+    void writeProfileDot(std::ostream& out, const RegexProfile& profile) const;
+
+    // requires the node graph, so isn't available for lexers loaded from
+    // image or taken from RegexCache
     void generateCProgram(const std::string& path);
 private:
 
+    RegexLexer() = default;
+
+    // node graph; empty when the lexer is loaded from image
     std::vector<std::unique_ptr<dtl::Node>> nodes;
+    std::shared_ptr<const char> image;
+    dtl::Program prog;
+    std::string pattern;
+    unsigned flags = NO_FLAGS;
     std::istream* istream = nullptr;
     std::string istreamString;
     int freeGroupId = 0;
+    RegexAnalysis analysis;
+    dtl::BitProgram bits;
+    // offset of the pattern symbol being parsed, see Node::patternPos
+    int parsePos = -1;
 
     void extractStringFromIstream(std::istream& s);
 
+    void compile(const std::string& pat);
     void parsePattern(const std::string& pat);
+    void compileProgram();
+    bool useImage(std::shared_ptr<const char> image, size_t size, std::string* error);
+    void attachImage(std::shared_ptr<const char> image);
+    bool getTokenNfa(const char** start, const char** end, RegexData& data) const;
+    bool getTokenBits(const char** start, const char** end, RegexData& data) const;
+    void pushTokens(PushState& state, const Sink& sink, bool final) const;
     void appendNode(dtl::Children_t& stack, dtl::Node* newNode, bool addEnd);
     void appendOrGroupNode(dtl::Children_t& stack, std::vector<dtl::Node*> orGroup, bool isExclusive);
     void adaptOrGroupSymbol(std::vector<dtl::Node*>& stack, std::vector<dtl::Node*>& group, dtl::OrGroupMode_t& mode, bool& isRangePending, const char* unit, int ulen, bool& isEscaped);
@@ -310,6 +868,7 @@ private:
     template<typename NodeType, typename... Args>
     dtl::Node* createNode(Args... args) {
         nodes.push_back(std::make_unique<NodeType>(std::forward<Args>(args)...));
+        nodes.back()->patternPos = parsePos;
         return nodes.back().get();
     }
 };
@@ -0,0 +1,60 @@
+#ifndef DLEXER_REGEXCACHE_H_
+#define DLEXER_REGEXCACHE_H_
+#include <string>
+#include <memory>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+namespace dlexer {
+
+// LRU cache of compiled regex images keyed by pattern and compile flags.
+// Images are immutable, so every lexer built from a cached pattern shares
+// the same one. Capacity is the total size in bytes of cached images and
+// keys; 0 (the default) disables the cache.
+class RegexCache {
+public:
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        size_t entries;
+        size_t bytes;
+    };
+
+    // the cache used by RegexLexer constructors and reprogram()
+    static RegexCache& global();
+
+    explicit RegexCache(size_t capacity = 0);
+
+    void setCapacity(size_t bytes);
+    size_t getCapacity() const;
+
+    // returns nullptr if not found
+    std::shared_ptr<const char> find(const std::string& pat, unsigned flags);
+    void insert(const std::string& pat, unsigned flags, std::shared_ptr<const char> image);
+    void clear();
+
+    Stats getStats() const;
+
+private:
+    struct Entry {
+        std::string key;
+        std::shared_ptr<const char> image;
+        size_t bytes;
+    };
+
+    mutable std::mutex mutex;
+    std::atomic<size_t> capacity;
+    std::list<Entry> lru;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    Stats stats = {};
+
+    static std::string makeKey(const std::string& pat, unsigned flags);
+    void evictUntilFits(size_t capacity);
+};
+
+} // namespace dlexer
+#endif // DLEXER_REGEXCACHE_H_
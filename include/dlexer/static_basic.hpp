@@ -0,0 +1,178 @@
+#ifndef DLEXER_STATIC_BASIC_H_
+#define DLEXER_STATIC_BASIC_H_
+#include <dlexer/basic.hpp>
+#include <dlexer/common.hpp>
+#include <string>
+#include <iostream>
+#include <cstddef>
+
+// Compile-time counterpart of BasicLexer.
+//
+// The delimiter pattern (with '<', '>', '^', '!' modifiers and '\' escapes)
+// is parsed in constexpr into a byte table for one-byte delimiters and
+// a short list for multibyte ones, so classifying a unit is a table lookup
+// followed by the include mode step BasicLexer runs.
+//
+// Usage:
+//     static constexpr char pat[] = " \t^";
+//     dlexer::static_basic<pat> l;
+//     while(l.getToken(out, in)) { ... }
+
+namespace dlexer {
+
+namespace dtl {
+namespace sbl {
+
+static const char NOT_BOUND = BasicLexer::NOT_BOUND;
+
+struct Bound {
+    unsigned char unit[4] = {0, 0, 0, 0};
+    int ulen = 0;
+    char type = BasicLexer::NO_INCLUDE;
+};
+
+template<size_t Cap>
+struct Bounds {
+    char byteType[256] {};
+    Bound multi[Cap] {};
+    int multiCount = 0;
+};
+
+constexpr int unitLength(char first) {
+    int ind = 0;
+    while(ind < 8 && (static_cast<unsigned char>(first) & (0x80 >> ind))) {
+        ind++;
+    }
+    return ind + (ind == 0);
+}
+
+constexpr size_t length(const char* s) {
+    size_t len = 0;
+    while(s[len] != '\0') { ++len; }
+    return len;
+}
+
+// mirrors BasicLexer::reprogram(); the first occurrence of a duplicated
+// delimiter wins, same as findUnit()
+template<size_t Cap>
+constexpr Bounds<Cap> parse(const char* pat, size_t len) {
+    Bound all[Cap] {};
+    int count = 0;
+    bool toEscape = false;
+
+    for(size_t i = 0; i < len;) {
+        const int ulen = unitLength(pat[i]);
+        if(ulen == 1 && !toEscape) {
+            char mod = NOT_BOUND;
+            switch(pat[i]) {
+            case '\\': toEscape = true; ++i; continue;
+            case '<': mod = BasicLexer::LEFT_INCLUDE; break;
+            case '>': mod = BasicLexer::RIGHT_INCLUDE; break;
+            case '^': mod = BasicLexer::STANDALONE; break;
+            case '!': mod = BasicLexer::WEAK_STANDALONE; break;
+            default: break;
+            }
+            if(mod != NOT_BOUND) {
+                if(count == 0) { throw "include modifier without delimiter"; }
+                all[count - 1].type = mod;
+                ++i;
+                continue;
+            }
+        }
+        if(i + ulen > len) { throw "truncated unit in pattern"; }
+
+        for(int uoff = 0; uoff < ulen; ++uoff) {
+            all[count].unit[uoff] = static_cast<unsigned char>(pat[i + uoff]);
+        }
+        all[count].ulen = ulen;
+        all[count].type = BasicLexer::NO_INCLUDE;
+        count++;
+        i += ulen;
+        toEscape = false;
+    }
+
+    Bounds<Cap> res {};
+    for(int b = 0; b < 256; ++b) { res.byteType[b] = NOT_BOUND; }
+
+    for(int i = 0; i < count; ++i) {
+        const Bound& b = all[i];
+        if(b.ulen == 1) {
+            if(res.byteType[b.unit[0]] == NOT_BOUND) { res.byteType[b.unit[0]] = b.type; }
+            continue;
+        }
+
+        bool seen = false;
+        for(int j = 0; j < res.multiCount && !seen; ++j) {
+            const Bound& m = res.multi[j];
+            seen = m.ulen == b.ulen;
+            for(int k = 0; k < b.ulen && seen; ++k) { seen = m.unit[k] == b.unit[k]; }
+        }
+        if(!seen) { res.multi[res.multiCount++] = b; }
+    }
+    return res;
+}
+
+} // namespace sbl
+} // namespace dtl
+
+template<const char* Pattern>
+struct static_basic {
+    static constexpr size_t PatternLength = dtl::sbl::length(Pattern);
+    static constexpr auto table = dtl::sbl::parse<PatternLength + 1>(Pattern, PatternLength);
+
+    char unit[4] = {0};
+    char includePrevMode = BasicLexer::NO_INCLUDE;
+
+    void endCurTokenList() { includePrevMode = BasicLexer::NO_INCLUDE; }
+
+    bool getToken(std::string& out, std::istream& in) {
+        return getToken(out, in, this->unit, this->includePrevMode);
+    }
+
+    // returns include mode of the unit or dtl::sbl::NOT_BOUND
+    static char includeTypeOf(const char* unit, int ulen) {
+        if(ulen == 1) { return table.byteType[static_cast<unsigned char>(unit[0])]; }
+
+        for(int i = 0; i < table.multiCount; ++i) {
+            const dtl::sbl::Bound& b = table.multi[i];
+            if(b.ulen != ulen) { continue; }
+
+            bool eq = true;
+            for(int k = 0; k < ulen && eq; ++k) {
+                eq = b.unit[k] == static_cast<unsigned char>(unit[k]);
+            }
+            if(eq) { return b.type; }
+        }
+        return dtl::sbl::NOT_BOUND;
+    }
+
+    // same semantics as BasicLexer::getToken()
+    static bool getToken(std::string& out, std::istream& in, char* unit, char& includePrevMode) {
+        if(in.eof()) {
+            return false;
+        }
+
+        out.clear();
+        auto append = [&]() { out.append(unit, unitLength(unit[0])); };
+
+        char justIncludedMode = BasicLexer::NO_INCLUDE;
+        while(true) {
+            if(BasicLexer::takePrevUnit(includePrevMode, justIncludedMode, append)) {
+                return true;
+            }
+
+            const int ulen = extractUnit(unit, in);
+
+            if(in.eof()) {
+                return out.length() != 0;
+            }
+
+            if(BasicLexer::takeUnit(includeTypeOf(unit, ulen), out.empty(), includePrevMode, justIncludedMode, append)) {
+                return true;
+            }
+        }
+    }
+};
+
+} // namespace dlexer
+#endif // DLEXER_STATIC_BASIC_H_
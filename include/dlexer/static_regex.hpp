@@ -0,0 +1,557 @@
+#ifndef DLEXER_STATIC_REGEX_H_
+#define DLEXER_STATIC_REGEX_H_
+#include <dlexer/regex.hpp>
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// Compile-time counterpart of RegexLexer.
+//
+// The pattern is parsed by a constexpr parser accepting the same syntax as
+// RegexLexer::parsePattern and every node of the resulting tree becomes its
+// own template instantiation, so the matcher is a chain of inlined calls
+// with no interpretation left at runtime. Token semantics (leftmost start,
+// first successful path in priority order, empty tokens skipping one unit)
+// follow RegexLexer::getToken.
+//
+// A repeated single unit or class is matched in a loop, so its tokens
+// may be of any length. Other repeated bodies recurse once per iteration;
+// a token needing more than MaxStarDepth nested iterations is handed to
+// a RegexLexer compiled from the same pattern, with the limits of data.
+//
+// Usage:
+//     static constexpr char pat[] = "([a-z]+)|([0-9]+)";
+//     using Lexer = dlexer::static_regex<pat>;
+//     RegexData data(str);
+//     while(Lexer::getToken(out, data)) { ... }
+
+namespace dlexer {
+
+namespace dtl {
+namespace sre {
+
+enum Kind: char {
+    SEQ,
+    ALT,
+    GROUP,
+    REPEAT,
+    UNIT,
+    CLASS,
+    AT_START,
+    AT_END,
+};
+
+enum RepeatMode: char {
+    ZERO_OR_MORE,
+    ZERO_OR_ONE,
+    ONE_OR_MORE,
+};
+
+struct Item {
+    Kind kind = SEQ;
+    // SEQ, ALT: children in kids[first, first + count)
+    // CLASS: ranges in ranges[first, first + count)
+    int first = 0;
+    int count = 0;
+    // GROUP, REPEAT
+    int child = -1;
+    int groupId = -1;
+    RepeatMode mode = ZERO_OR_MORE;
+    bool isLazy = false;
+    bool isNegative = false;
+    unsigned char unit[4] = {0, 0, 0, 0};
+    int ulen = 0;
+};
+
+struct Range {
+    unsigned char start[4] = {0, 0, 0, 0};
+    unsigned char end[4] = {0, 0, 0, 0};
+    int len = 0;
+};
+
+template<size_t Cap>
+struct Ast {
+    Item items[Cap] {};
+    int kids[Cap] {};
+    Range ranges[Cap] {};
+    int itemCount = 0;
+    int kidCount = 0;
+    int rangeCount = 0;
+    int groupCount = 0;
+    int root = -1;
+};
+
+constexpr size_t length(const char* s) {
+    size_t len = 0;
+    while(s[len] != '\0') { ++len; }
+    return len;
+}
+
+// same as dlexer::unitLength, usable in constant expressions
+constexpr int unitLength(char first) {
+    int ind = 0;
+    while(ind < 8 && (static_cast<unsigned char>(first) & (0x80 >> ind))) {
+        ind++;
+    }
+    return ind + (ind == 0);
+}
+
+// every unit of the pattern produces at most a unit, a repeat and
+// a sequence wrapper
+constexpr size_t capacityFor(size_t patLen) { return 3*patLen + 4; }
+
+template<size_t Cap>
+struct Parser {
+    Ast<Cap> ast {};
+    const char* pat;
+    size_t len;
+    size_t at = 0;
+
+    constexpr Parser(const char* pat, size_t len): pat(pat), len(len) {}
+
+    constexpr Ast<Cap> parse() {
+        ast.root = parseAlt();
+        if(at != len) { throw "unmatched ')' in pattern"; }
+        return ast;
+    }
+
+private:
+    constexpr int newItem(Kind kind) {
+        if(ast.itemCount == static_cast<int>(Cap)) { throw "pattern is too long"; }
+        ast.items[ast.itemCount] = Item{};
+        ast.items[ast.itemCount].kind = kind;
+        return ast.itemCount++;
+    }
+
+    constexpr int takeUnit(unsigned char* dst) {
+        const int ulen = unitLength(pat[at]);
+        if(at + ulen > len) { throw "truncated unit in pattern"; }
+        for(int i = 0; i < ulen; ++i) {
+            dst[i] = static_cast<unsigned char>(pat[at + i]);
+        }
+        at += ulen;
+        return ulen;
+    }
+
+    constexpr int wrapKids(Kind kind, const int* list, int n) {
+        const int id = newItem(kind);
+        ast.items[id].first = ast.kidCount;
+        ast.items[id].count = n;
+        for(int i = 0; i < n; ++i) {
+            ast.kids[ast.kidCount++] = list[i];
+        }
+        return id;
+    }
+
+    constexpr int parseAlt() {
+        int seqs[Cap] {};
+        int n = 0;
+
+        seqs[n++] = parseSeq();
+        while(at < len && pat[at] == '|') {
+            ++at;
+            seqs[n++] = parseSeq();
+        }
+
+        if(n == 1) { return seqs[0]; }
+        return wrapKids(ALT, seqs, n);
+    }
+
+    constexpr int parseSeq() {
+        int list[Cap] {};
+        int n = 0;
+
+        while(at < len && pat[at] != '|' && pat[at] != ')') {
+            int atom = parseAtom();
+
+            while(at < len && (pat[at] == '*' || pat[at] == '+' || pat[at] == '?')) {
+                const int rep = newItem(REPEAT);
+                ast.items[rep].child = atom;
+                ast.items[rep].mode = pat[at] == '*' ? ZERO_OR_MORE
+                    : pat[at] == '+' ? ONE_OR_MORE : ZERO_OR_ONE;
+                ++at;
+                if(at < len && pat[at] == '?') {
+                    ast.items[rep].isLazy = true;
+                    ++at;
+                }
+                atom = rep;
+            }
+            list[n++] = atom;
+        }
+
+        if(n == 1) { return list[0]; }
+        return wrapKids(SEQ, list, n);
+    }
+
+    constexpr int parseAtom() {
+        switch(pat[at]) {
+        case '(': {
+            ++at;
+            const int group = newItem(GROUP);
+            ast.items[group].groupId = ast.groupCount++;
+            const int child = parseAlt();
+            if(at == len || pat[at] != ')') { throw "unmatched '(' in pattern"; }
+            ++at;
+            ast.items[group].child = child;
+            return group;
+        }
+        case '[': ++at; return parseClass();
+        case '^': ++at; return newItem(AT_START);
+        case '$': ++at; return newItem(AT_END);
+        case '*': case '+': case '?': throw "nothing to repeat in pattern";
+        case '\\': {
+            ++at;
+            if(at == len) { throw "trailing '\\' in pattern"; }
+        } break;
+        default: break;
+        }
+
+        const int unit = newItem(UNIT);
+        ast.items[unit].ulen = takeUnit(ast.items[unit].unit);
+        return unit;
+    }
+
+    constexpr int parseClass() {
+        const int cls = newItem(CLASS);
+        ast.items[cls].first = ast.rangeCount;
+
+        bool isEscaped = false;
+        while(true) {
+            if(at == len) { throw "unmatched '[' in pattern"; }
+            Range& cur = ast.ranges[ast.rangeCount];
+
+            if(!isEscaped && unitLength(pat[at]) == 1) {
+                const char c = pat[at];
+                if(c == '^' && ast.items[cls].count == 0 && !ast.items[cls].isNegative) {
+                    ast.items[cls].isNegative = true;
+                    ++at;
+                    continue;
+                }
+                if(c == '-' && ast.items[cls].count != 0) {
+                    ++at;
+                    if(at == len) { throw "unmatched '[' in pattern"; }
+                    Range& prev = ast.ranges[ast.rangeCount - 1];
+                    const int endlen = takeUnit(prev.end);
+                    if(endlen != prev.len) { throw "range bounds differ in length"; }
+                    continue;
+                }
+                if(c == ']') {
+                    ++at;
+                    return cls;
+                }
+                if(c == '\\') {
+                    isEscaped = true;
+                    ++at;
+                    continue;
+                }
+            }
+
+            cur.len = takeUnit(cur.start);
+            for(int i = 0; i < 4; ++i) { cur.end[i] = cur.start[i]; }
+            ast.rangeCount++;
+            ast.items[cls].count++;
+            isEscaped = false;
+        }
+    }
+};
+
+template<size_t Cap>
+constexpr Ast<Cap> parse(const char* pat, size_t len) {
+    return Parser<Cap>(pat, len).parse();
+}
+
+// length of every unit the UNIT or CLASS item accepts, 0 if it varies
+template<size_t Cap>
+constexpr int fixedUnitLength(const Ast<Cap>& ast, const Item& it) {
+    if(it.kind == UNIT) { return it.ulen; }
+    if(it.isNegative || it.count == 0) { return 0; }
+    const int len = ast.ranges[it.first].len;
+    for(int r = it.first; r < it.first + it.count; ++r) {
+        if(ast.ranges[r].len != len) { return 0; }
+    }
+    return len;
+}
+
+} // namespace sre
+} // namespace dtl
+
+template<const char* Pattern>
+struct static_regex {
+    static constexpr size_t PatternLength = dtl::sre::length(Pattern);
+    static constexpr auto ast = dtl::sre::parse<
+        dtl::sre::capacityFor(PatternLength)>(Pattern, PatternLength);
+    static constexpr int groupCount = ast.groupCount;
+    // iterations of repeated groups and sequences on the call stack
+    static constexpr int MaxStarDepth = 1024;
+
+    static bool getToken(const char** start, const char** end, RegexData& data) {
+        if(data.at == RegexData::LINE_AT_PAST_EOF) { return false; }
+
+        data.groups.assign(groupCount, RegexData::Group{ -1, -1 });
+
+        Ctx c{ data.str, static_cast<int>(data.strLen), data.groups.data() };
+        int s = data.pos;
+        while(true) {
+            int matchEnd = -1;
+            const bool found = match<ast.root>(c, s, [&](int p) {
+                matchEnd = p;
+                return true;
+            });
+
+            // earlier starts didn't match, so the lexer starts at s too
+            if(c.overflow) {
+                static const RegexLexer fallback(Pattern, RegexLexer::BACKTRACK);
+                data.rewindTo(s);
+                return fallback.getToken(start, end, data);
+            }
+            if(found) {
+                data.startPos = s;
+                data.pos = matchEnd;
+                if(s == matchEnd) {
+                    if(matchEnd == c.len) {
+                        data.at = RegexData::LINE_AT_PAST_EOF;
+                    } else {
+                        data.pos += unitLen(c, matchEnd);
+                        data.startPos = data.pos;
+                        data.at = lineAt(c, data.pos);
+                    }
+                } else {
+                    data.at = lineAt(c, data.pos);
+                }
+
+                *start = data.str + data.startPos;
+                *end = data.str + data.pos;
+                return true;
+            }
+
+            if(s >= c.len) {
+                data.startPos = data.pos = c.len;
+                data.at = RegexData::LINE_AT_PAST_EOF;
+                return false;
+            }
+            s += unitLen(c, s);
+        }
+    }
+
+    static bool getToken(std::string& out, RegexData& data) {
+        const char* start;
+        const char* end;
+        if(!getToken(&start, &end, data)) { return false; }
+
+        out.assign(start, end);
+        return true;
+    }
+
+private:
+    using Item = dtl::sre::Item;
+
+    struct Ctx {
+        const char* str;
+        int len;
+        RegexData::Group* groups;
+        // nested iterations of star()
+        int depth = 0;
+        // set once depth exceeds MaxStarDepth; the match is then abandoned
+        bool overflow = false;
+        // unit ends of unitStar() runs, for units of varying length
+        std::vector<int> ends;
+    };
+
+    static int unitLen(const Ctx& c, int pos) {
+        const int ulen = dtl::sre::unitLength(c.str[pos]);
+        return pos + ulen <= c.len ? ulen : c.len - pos;
+    }
+
+    // mirrors RegexData::updateAt()
+    static decltype(RegexData::at) lineAt(const Ctx& c, int pos) {
+        if(pos == c.len) { return RegexData::LINE_AT_EOF; }
+        if(pos == 0) { return RegexData::LINE_AT_START; }
+        if(c.str[pos - 1] == '\n' || c.str[pos] == '\n') { return RegexData::LINE_AT_END; }
+        return RegexData::LINE_AT_MID;
+    }
+
+    static bool inRange(const dtl::sre::Range& r, const char* unit, int ulen) {
+        if(ulen != r.len) { return false; }
+        for(int i = 0; i < ulen; ++i) {
+            const unsigned char u = static_cast<unsigned char>(unit[i]);
+            if(u != r.start[i]) {
+                if(u < r.start[i]) { return false; }
+                break;
+            }
+        }
+        for(int i = 0; i < ulen; ++i) {
+            const unsigned char u = static_cast<unsigned char>(unit[i]);
+            if(u != r.end[i]) { return u < r.end[i]; }
+        }
+        return true;
+    }
+
+    template<int I, typename K>
+    static bool match(Ctx& c, int pos, const K& k) {
+        constexpr const Item& it = ast.items[I];
+
+        if constexpr(it.kind == dtl::sre::UNIT || it.kind == dtl::sre::CLASS) {
+            const int p = unitEnd<I>(c, pos);
+            return p != -1 && k(p);
+        } else if constexpr(it.kind == dtl::sre::AT_START) {
+            if(lineAt(c, pos) == RegexData::LINE_AT_MID) { return false; }
+            return k(pos);
+        } else if constexpr(it.kind == dtl::sre::AT_END) {
+            const auto at = lineAt(c, pos);
+            if(at != RegexData::LINE_AT_EOF && at != RegexData::LINE_AT_END) { return false; }
+            return k(pos);
+        } else if constexpr(it.kind == dtl::sre::SEQ) {
+            return seq<I, 0>(c, pos, k);
+        } else if constexpr(it.kind == dtl::sre::ALT) {
+            return alt<I, 0>(c, pos, k);
+        } else if constexpr(it.kind == dtl::sre::GROUP) {
+            RegexData::Group& g = c.groups[it.groupId];
+            const RegexData::Group saved = g;
+            g.start = pos;
+            const bool res = match<it.child>(c, pos, [&](int p) {
+                const int savedEnd = g.end;
+                g.end = p;
+                if(k(p)) { return true; }
+                g.end = savedEnd;
+                return false;
+            });
+            if(!res) { g = saved; }
+            return res;
+        } else if constexpr(it.kind == dtl::sre::REPEAT) {
+            if constexpr(it.mode == dtl::sre::ZERO_OR_ONE) {
+                if constexpr(it.isLazy) {
+                    return k(pos) || match<it.child>(c, pos, k);
+                } else {
+                    return match<it.child>(c, pos, k) || k(pos);
+                }
+            } else if constexpr(it.mode == dtl::sre::ZERO_OR_MORE) {
+                return star<I>(c, pos, k);
+            } else {
+                return match<it.child>(c, pos, [&](int p) {
+                    return star<I>(c, p, k);
+                });
+            }
+        }
+    }
+
+    // end of the unit at pos if the UNIT or CLASS item accepts it, otherwise -1
+    template<int I>
+    static int unitEnd(const Ctx& c, int pos) {
+        constexpr const Item& it = ast.items[I];
+
+        if constexpr(it.kind == dtl::sre::UNIT) {
+            if(pos + it.ulen > c.len || dtl::sre::unitLength(c.str[pos]) != it.ulen) {
+                return -1;
+            }
+            for(int i = 0; i < it.ulen; ++i) {
+                if(static_cast<unsigned char>(c.str[pos + i]) != it.unit[i]) { return -1; }
+            }
+            return pos + it.ulen;
+        } else {
+            if(pos >= c.len) { return -1; }
+            const int ulen = unitLen(c, pos);
+            bool in = false;
+            for(int r = it.first; r < it.first + it.count && !in; ++r) {
+                in = inRange(ast.ranges[r], c.str + pos, ulen);
+            }
+            if(in == it.isNegative) { return -1; }
+            return pos + ulen;
+        }
+    }
+
+    // iterations that consume nothing are not repeated
+    template<int I, typename K>
+    static bool star(Ctx& c, int pos, const K& k) {
+        constexpr const Item& it = ast.items[I];
+        constexpr dtl::sre::Kind childKind = ast.items[it.child].kind;
+
+        if constexpr(childKind == dtl::sre::UNIT || childKind == dtl::sre::CLASS) {
+            return unitStar<I>(c, pos, k);
+        } else {
+            if(c.overflow) { return false; }
+            const auto again = [&](int p) {
+                if(p == pos) { return false; }
+                if(c.depth == MaxStarDepth) {
+                    c.overflow = true;
+                    return false;
+                }
+                c.depth++;
+                const bool res = star<I>(c, p, k);
+                c.depth--;
+                return res;
+            };
+
+            if constexpr(it.isLazy) {
+                return k(pos) || match<it.child>(c, pos, again);
+            } else {
+                return match<it.child>(c, pos, again) || k(pos);
+            }
+        }
+    }
+
+    // A unit has no groups and always consumes, so iterations only differ
+    // in where the run ends: the greedy star takes the longest run and
+    // tries the continuation from its end backwards, the lazy one from
+    // pos forwards.
+    template<int I, typename K>
+    static bool unitStar(Ctx& c, int pos, const K& k) {
+        constexpr const Item& it = ast.items[I];
+        constexpr int ulen = dtl::sre::fixedUnitLength(ast, ast.items[it.child]);
+
+        if constexpr(it.isLazy) {
+            for(int p = pos; p != -1 && !c.overflow; p = unitEnd<it.child>(c, p)) {
+                if(k(p)) { return true; }
+            }
+            return false;
+        } else if constexpr(ulen != 0) {
+            int p = pos;
+            for(int next = unitEnd<it.child>(c, p); next != -1; next = unitEnd<it.child>(c, p)) {
+                p = next;
+            }
+            for(; p >= pos && !c.overflow; p -= ulen) {
+                if(k(p)) { return true; }
+            }
+            return false;
+        } else {
+            // ends of the run are kept above the ones of enclosing runs
+            const size_t base = c.ends.size();
+            for(int p = unitEnd<it.child>(c, pos); p != -1; p = unitEnd<it.child>(c, p)) {
+                c.ends.push_back(p);
+            }
+            bool res = false;
+            for(size_t i = c.ends.size(); i > base && !res && !c.overflow; --i) {
+                res = k(c.ends[i - 1]);
+            }
+            c.ends.resize(base);
+            return res || (!c.overflow && k(pos));
+        }
+    }
+
+    template<int I, int J, typename K>
+    static bool seq(Ctx& c, int pos, const K& k) {
+        constexpr const Item& it = ast.items[I];
+
+        if constexpr(J == it.count) {
+            return k(pos);
+        } else {
+            return match<ast.kids[it.first + J]>(c, pos, [&](int p) {
+                return seq<I, J + 1>(c, p, k);
+            });
+        }
+    }
+
+    template<int I, int J, typename K>
+    static bool alt(Ctx& c, int pos, const K& k) {
+        constexpr const Item& it = ast.items[I];
+
+        if constexpr(J == it.count) {
+            return false;
+        } else {
+            return match<ast.kids[it.first + J]>(c, pos, k)
+                || alt<I, J + 1>(c, pos, k);
+        }
+    }
+};
+
+} // namespace dlexer
+#endif // DLEXER_STATIC_REGEX_H_
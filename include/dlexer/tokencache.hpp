@@ -0,0 +1,100 @@
+#ifndef DLEXER_TOKENCACHE_H_
+#define DLEXER_TOKENCACHE_H_
+#include <dlexer/regex.hpp>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+
+namespace dlexer {
+
+// LRU cache of tokens of records, keyed by the record text, for input
+// where the same lines recur. A record's tokens are kept as RecordBatch
+// spans, which are offsets in the record, so they fit any copy of it.
+// Entries depend on the lexer that made them: a cache is for one lexer.
+// Capacity is the total size in bytes of cached records and spans; 0
+// (the default) disables the cache. A record is added on its second
+// miss, so lines seen once don't push recurring ones out. Entries are
+// spread by hash over shards with locks of their own, each holding a
+// part of the capacity, so that BatchLexer threads rarely wait for each
+// other.
+class TokenCache {
+public:
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        size_t entries;
+        size_t bytes;
+    };
+
+    static const size_t ShardCount = 16;
+    // hashes of records missed once, slot is taken by hash
+    static const size_t SeenSlots = 16 * 1024;
+
+    explicit TokenCache(size_t capacity = 0);
+    TokenCache(const TokenCache&) = delete;
+    TokenCache& operator=(const TokenCache&) = delete;
+
+    void setCapacity(size_t bytes);
+    size_t getCapacity() const;
+
+    // appends spans and matched flags of record's tokens and returns
+    // true if it's cached
+    bool find(std::string_view record, std::vector<RegexBatch::Span>& spans, std::vector<uint8_t>& matched);
+    // count spans and flags starting at spans and matched; a record
+    // missed only once is remembered instead
+    void insert(std::string_view record, const RegexBatch::Span* spans, const uint8_t* matched, size_t count);
+    void clear();
+
+    Stats getStats() const;
+
+private:
+    // One allocation: the fields are followed by count spans, count
+    // matched flags and the key.
+    struct Entry {
+        Entry* prev;
+        Entry* next;
+        uint64_t hash;
+        size_t bytes;
+        uint32_t count;
+        uint32_t keyLen;
+
+        RegexBatch::Span* spans() { return reinterpret_cast<RegexBatch::Span*>(this + 1); }
+        uint8_t* matched() { return reinterpret_cast<uint8_t*>(spans() + count); }
+        std::string_view key() { return std::string_view(reinterpret_cast<char*>(matched() + count), keyLen); }
+    };
+    // Keyed by hash only, so that a lookup doesn't copy the record; the
+    // key is compared on a hit, and a record colliding with a cached one
+    // replaces it.
+    struct Shard {
+        mutable std::mutex mutex;
+        // most recently used first
+        Entry* head = nullptr;
+        Entry* tail = nullptr;
+        std::unordered_map<uint64_t, Entry*> index;
+        Stats stats = {};
+
+        ~Shard();
+        void unlink(Entry* e);
+        void pushFront(Entry* e);
+        void erase(Entry* e);
+        void evictUntilFits(size_t limit);
+    };
+
+    std::atomic<size_t> capacity;
+    // read and written without a lock: a lost update only delays or
+    // hastens adding a record
+    std::unique_ptr<std::atomic<uint64_t>[]> seen;
+    Shard shards[ShardCount];
+
+    Shard& shardOf(uint64_t hash) { return shards[hash % ShardCount]; }
+    size_t shardCapacity() const { return capacity / ShardCount; }
+};
+
+} // namespace dlexer
+#endif // DLEXER_TOKENCACHE_H_
@@ -1,7 +1,12 @@
 #ifndef DLEXER_TYPED_H
 #define DLEXER_TYPED_H
 #include <string>
+#include <string_view>
+#include <iterator>
 #include <vector>
+#include <functional>
+#include <utility>
+#include <cstdint>
 
 namespace dlexer {
 
@@ -13,6 +18,21 @@ struct TypedLexer {
     };
     std::vector<NameContentPair> types;
 
+    // Type of every unit of the contents, so that a unit is classified
+    // with a lookup instead of a search of every content. Built by the
+    // constructors and reprogram(); the first type containing a unit wins.
+    struct TypeTable {
+        // type of one byte units, -2 for bytes starting longer units of
+        // some type
+        short byteType[256];
+        // longer units as big-endian numbers and their types, by key
+        std::vector<std::pair<uint64_t, int>> multi;
+
+        void build(const std::vector<NameContentPair>& types);
+        // -1 if no type contains the unit
+        int typeOf(const char* unit, int ulen) const;
+    } table;
+
     struct Data {
         char unit[4];
         int outType;
@@ -20,12 +40,95 @@ struct TypedLexer {
         bool toIncludePrev;
     } data = {0};
 
+    // Push API state, as BasicLexer's
+    struct PushState {
+        Data data = {0};
+        std::string out;
+        char partial[4] = {0};
+        int partialLen = 0;
+    } pushState;
+    using Sink = std::function<void(const std::string& token, int type)>;
+
     TypedLexer(std::vector<NameContentPair>&& types);
     TypedLexer(const std::string& pat);
     void reprogram(const std::string& pat);
     bool getToken(std::string& out, std::istream& in);
     bool getToken(std::string& out, std::istream& in, Data& data) const;
+
+    // Push API, as BasicLexer's; sink also gets index of the token's type
+    void feed(const char* chunk, size_t len, const Sink& sink);
+    void finish(const Sink& sink);
+    void feed(const char* chunk, size_t len, PushState& state, const Sink& sink) const;
+    void finish(PushState& state, const Sink& sink) const;
     void endCurTokenList();
+    struct Token {
+        std::string_view text;
+        // index in types
+        int type;
+    };
+    // getToken() state over a string in memory: where the next unit is,
+    // the last unit, its type and the type of the last token
+    struct StrData {
+        size_t pos = 0;
+        size_t unitPos = 0;
+        int ulen = 0;
+        int curType = -1;
+        int outType = 0;
+        bool toIncludePrev = false;
+    };
+    // getToken() without copies, out.text is a view of str, which must
+    // be the same string on every call with data
+    bool getToken(Token& out, std::string_view str, StrData& data) const;
+
+    // A run is units of one type in a row, type is -1 for units of no
+    // type. Runs cover the whole string, so their lengths add up to its
+    // size, and runs of a type are the tokens getToken() gives.
+    struct Run {
+        int type;
+        size_t length;
+    };
+    // replaces out with runs of str
+    void getRuns(std::string_view str, std::vector<Run>& out) const;
+    // Input iterator over tokens of a string in memory. A token is a view
+    // of the string and is valid while the string is.
+    class TokenIterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = Token;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Token*;
+        using reference = const Token&;
+
+        // end of any range
+        TokenIterator() = default;
+        TokenIterator(const TypedLexer& lexer, std::string_view str);
+
+        reference operator*() const { return token; }
+        pointer operator->() const { return &token; }
+        TokenIterator& operator++();
+        TokenIterator operator++(int) {
+            TokenIterator res = *this;
+            ++*this;
+            return res;
+        }
+        bool operator==(const TokenIterator& r) const { return lexer == r.lexer && data.pos == r.data.pos; }
+        bool operator!=(const TokenIterator& r) const { return !(*this == r); }
+
+    private:
+        // nullptr at the end
+        const TypedLexer* lexer = nullptr;
+        std::string_view str;
+        StrData data;
+        Token token = { std::string_view(), 0 };
+    };
+    struct TokenRange {
+        TokenIterator first;
+        TokenIterator begin() const { return first; }
+        TokenIterator end() const { return TokenIterator(); }
+    };
+    // str must outlive the range
+    TokenRange tokens(std::string_view str) const;
+
     void writeAsCppProgram(std::ofstream& out) const;
 };
 
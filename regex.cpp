@@ -1,5 +1,7 @@
 #include <dlexer/regex.hpp>
 #include <dlexer/common.hpp>
+#include <dlexer/regexcache.hpp>
+#include "regexstats.hpp"
 #include <cctype>
 #include <cstring>
 #include <sstream>
@@ -100,21 +102,34 @@ void adaptEndGroupNode(GroupNode& end, Node& curParent) {
 
 using namespace dtl;
 
-RegexLexer::RegexLexer(const std::string& pat) {
-    createNode<StartNode>();
-
-    parsePattern(pat);
+RegexLexer::RegexLexer(const std::string& pat, unsigned flags): flags(flags) {
+    compile(pat);
 }
 
 void RegexLexer::reprogram(const std::string& pat) {
-    nodes.resize(1);
     err = nullptr;
     data = RegexData{};
 
+    compile(pat);
+}
+
+void RegexLexer::compile(const std::string& pat) {
+    nodes.clear();
+
+    RegexCache& cache = RegexCache::global();
+    std::shared_ptr<const char> cached = cache.find(pat, flags);
+    if(cached != nullptr) {
+        attachImage(std::move(cached));
+        return;
+    }
+
+    createNode<StartNode>();
+    freeGroupId = 0;
+
     parsePattern(pat);
+    compileProgram();
 
-    std::vector<Node*> path;
-    std::vector<int> groupsOnPath;
+    cache.insert(pat, flags, image);
 }
 
 static void print(Node* n, int d, std::vector<Node*> traversed) {
@@ -253,6 +268,8 @@ void RegexLexer::adaptOrGroupSymbol(std::vector<dtl::Node*>& stack, std::vector<
 }
 
 void RegexLexer::parsePattern(const std::string& pat) {
+    this->pattern = pat;
+
     std::vector<GroupNode*> groupStartStack;
     std::vector<Node*> orGroup;
     bool isRangePending = false;
@@ -271,6 +288,7 @@ void RegexLexer::parsePattern(const std::string& pat) {
     
     for(int byteInd = 0; byteInd < pat.size(); byteInd += ulen) {
         ulen = extractUnitStr(unit, pat.c_str() + byteInd);
+        parsePos = byteInd;
 
         Node* newNode = nullptr;
 
@@ -335,6 +353,7 @@ void RegexLexer::parsePattern(const std::string& pat) {
         appendNode(stack, newNode, true);
     }
 
+    parsePos = -1;
     stack.back()->adaptChild(stack, *createNode<EndNode>(), stack.size());
 
 #if 0
@@ -344,35 +363,228 @@ void RegexLexer::parsePattern(const std::string& pat) {
 #endif
 }
 
+int dtl::satisfies(const Program& prog, const ProgNode& n, RegexData& data) {
+    switch(n.kind) {
+    case PROG_UNIT: {
+        if((data.ulen == n.ulen) & (std::memcmp(n.a, data.unit, data.ulen) == 0)) {
+            return 0;
+        }
+        return -1;
+    }
+    case PROG_RANGE: {
+        if(data.ulen != n.ulen
+        || std::memcmp(n.a, data.unit, n.ulen) > 0
+        || std::memcmp(n.b, data.unit, n.ulen) < 0) { return -1; }
+        return 0;
+    }
+    case PROG_OR: {
+        if(!(n.flags & PROG_NEGATIVE)) { return 0; }
+        assert(n.childCount > 1);
+
+        // If negative, checks that every child except the last one is not satisfied;
+        //      If so, returns index of the last child; otherwise, returns -1.
+        for(int i = 0; i < n.childCount - 1; ++i) {
+            if(satisfies(prog, prog.child(n, i), data) != -1) {
+                return -1;
+            }
+        }
+        return n.childCount - 1;
+    }
+    case PROG_GROUP: {
+        // groups are empty while RegexData::lazyGroups matching runs
+        if(!(n.flags & PROG_CAPTURE) || data.groups.empty()) { return 0; }
+        assert(n.groupId >= 0 && n.groupId < static_cast<int>(data.groups.size())
+            && "only not capturing group may have id < 0");
+
+        if(n.flags & PROG_IS_END) {
+            data.groups[n.groupId].end = data.pos;
+        } else {
+            data.groups[n.groupId].start = data.pos;
+        }
+        return 0;
+    }
+    // matches both start and end (where end is line or file end)
+    case PROG_AT_START: {
+        if(data.at == RegexData::LINE_AT_EOF) { data.markHitEnd(data.startPos); }
+        return -1 * (data.at == RegexData::LINE_AT_MID);
+    }
+    case PROG_AT_END: {
+        if(data.at == RegexData::LINE_AT_EOF) { data.markHitEnd(data.startPos); }
+        return -1 * !(data.at == RegexData::LINE_AT_EOF 
+            || data.at == RegexData::LINE_AT_END);
+    }
+    case PROG_REPEAT: return 0;
+    case PROG_END: return 0;
+    case PROG_START: return -1;
+    case PROG_FAIL: return -1;
+    }
+    return -1;
+}
+
+// has side effects only for capturing groups
+static void revert(const ProgNode& n, RegexData& data) {
+    if(n.kind != PROG_GROUP || !(n.flags & PROG_CAPTURE) || data.groups.empty()) { return; }
+
+    if(n.flags & PROG_IS_END) {
+        data.groups[n.groupId].end = -1;
+    } else {
+        data.groups[n.groupId].start = -1;
+    }
+}
+
+// skips units that can't start a match
+static void skipToPossibleStart(const Program& prog, RegexData& data) {
+    if(prog.header->anyFirstByte) { return; }
+
+    while(data.pos < data.strLen && !prog.canStartWith(data.str[data.pos])) {
+        data.extractUnit();
+    }
+    data.startPos = data.pos;
+}
+
+// Visited set of RegexLexer::MEMOIZE over positions [base, base + window).
+// Whether the rest of the pattern matches after a node depends only on
+// the node and position (groups don't affect matching), so a state seen
+// again either failed already or is a loop without progress.
+//
+// Groups do depend on the path: a failed attempt leaves every group
+// field it wrote at -1, as revert() doesn't restore older values. So
+// that groups are the backtracker's, each stack frame collects the
+// fields its subtree reset, a failed state keeps them as its effect and
+// a state pruned later resets them again.
+struct Memo {
+    bool enabled = false;
+    // groups are kept, so effects are tracked
+    bool tracksGroups = false;
+    int base = 0;
+    uint64_t window = 0;
+    uint64_t nodeCount = 0;
+    // words of a set of group fields
+    size_t words = 0;
+
+    Memo(const Program& prog, RegexData& data) {
+        if(!(prog.header->flags & RegexLexer::MEMOIZE)) { return; }
+
+        for(const uint32_t w: data.visitedDirty) { data.visited[w] = 0; }
+        data.visitedDirty.clear();
+
+        enabled = true;
+        base = data.pos;
+        nodeCount = prog.header->nodeCount;
+        window = std::min<uint64_t>(data.strLen - data.pos + 1, RegexLexer::MaxMemoBits / nodeCount);
+        const size_t bitWords = (window * nodeCount + 63) / 64;
+        if(data.visited.size() < bitWords) { data.visited.resize(bitWords, 0); }
+
+        tracksGroups = !data.groups.empty();
+        words = (2 * data.groups.size() + 63) / 64;
+        data.memoFrames.clear();
+        data.memoEffects.clear();
+        data.memoEffectAt.clear();
+    }
+
+    // bit of the state, -1 if it's out of the window
+    int64_t bitOf(int node, int pos) const {
+        if(!enabled || static_cast<uint64_t>(pos - base) >= window) { return -1; }
+        return (pos - base) * nodeCount + node;
+    }
+
+    // returns true if the state was visited before
+    bool visit(RegexData& data, int node, int pos) const {
+        const int64_t bit = bitOf(node, pos);
+        if(bit == -1) { return false; }
+
+        uint64_t& word = data.visited[bit / 64];
+        const uint64_t mask = uint64_t(1) << (bit % 64);
+        if(word & mask) { return true; }
+
+        if(word == 0) { data.visitedDirty.push_back(bit / 64); }
+        word |= mask;
+        return false;
+    }
+
+    uint64_t* frame(RegexData& data, size_t i) const { return data.memoFrames.data() + i * words; }
+    uint64_t* top(RegexData& data) const { return frame(data, data.stack.size() - 1); }
+
+    // after a frame is pushed on data.stack
+    void pushed(RegexData& data) const {
+        if(tracksGroups) { data.memoFrames.resize(data.stack.size() * words, 0); }
+    }
+    // revert() of n in the top frame
+    void reverted(RegexData& data, const ProgNode& n) const {
+        if(!tracksGroups || n.kind != PROG_GROUP || !(n.flags & PROG_CAPTURE)) { return; }
+        const size_t field = 2 * n.groupId + ((n.flags & PROG_IS_END) ? 1 : 0);
+        top(data)[field / 64] |= uint64_t(1) << (field % 64);
+    }
+    // before the top frame, the one of a failed state, is popped
+    void popping(RegexData& data, int node, int pos) const {
+        if(!tracksGroups) { return; }
+
+        uint64_t* f = top(data);
+        const int64_t bit = bitOf(node, pos);
+        if(bit != -1 && std::any_of(f, f + words, [](uint64_t w) { return w != 0; })) {
+            data.memoEffectAt[bit] = data.memoEffects.size();
+            data.memoEffects.insert(data.memoEffects.end(), f, f + words);
+        }
+        if(data.stack.size() >= 2) {
+            uint64_t* parent = frame(data, data.stack.size() - 2);
+            for(size_t i = 0; i < words; ++i) { parent[i] |= f[i]; }
+        }
+        data.memoFrames.resize((data.stack.size() - 1) * words);
+    }
+    // a visited state is pruned instead of being explored again
+    void pruned(RegexData& data, int node, int pos) const {
+        if(!tracksGroups) { return; }
+
+        const auto found = data.memoEffectAt.find(bitOf(node, pos));
+        if(found == data.memoEffectAt.end()) { return; }
+        const uint64_t* effect = data.memoEffects.data() + found->second;
+        uint64_t* f = top(data);
+        for(size_t field = 0; field < 2 * data.groups.size(); ++field) {
+            if(!(effect[field / 64] & (uint64_t(1) << (field % 64)))) { continue; }
+            RegexData::Group& g = data.groups[field / 2];
+            (field % 2 ? g.end : g.start) = -1;
+        }
+        for(size_t i = 0; i < words; ++i) { f[i] |= effect[i]; }
+    }
+};
+
 // returns true if:
 //      a node with free children is found 
 //      or there's some string to parse yet
 // otherwise, returns false
-static bool popUntilFreeChildren(RegexData& data, bool hasLastUnitFetched) {
+static bool popUntilFreeChildren(const Program& prog, RegexData& data, const Memo& memo, bool hasLastUnitFetched) {
     if(hasLastUnitFetched) { data.returnUnit(); }
 
     while(data.stack.size() > 1) {
         const NodeMem back = data.stack.back();
-        if(back.firstUnprocessedChild < back.node->children.size()) {
+        // see NodeMem
+        const uint32_t id = prog.children[data.stack[data.stack.size() - 2].nextChild - 1];
+        const ProgNode& node = prog.nodes[id];
+        if(back.nextChild < node.firstChild + node.childCount) {
             return true;
         }
 
-        back.node->revert(data);
-        if(back.node->needsUnit) {
+        revert(node, data);
+        memo.reverted(data, node);
+        memo.popping(data, id, data.pos);
+        if(node.flags & PROG_NEEDS_UNIT) {
             data.returnUnit();
+            STAT_NODE(data, id, backtracks);
         }
         data.stack.pop_back();
     }
 
-    const NodeMem startNode = data.stack[0];
-    if(startNode.firstUnprocessedChild < startNode.node->children.size()) {
+    const ProgNode& startNode = prog.nodes[0];
+    if(data.stack[0].nextChild < startNode.firstChild + startNode.childCount) {
         return true;
     }
 
-    data.stack[0].firstUnprocessedChild = 0;
+    data.stack[0].nextChild = startNode.firstChild;
+    STAT_COUNT(data, failedStarts);
     // proceed by one unit if whole pattern was impossible
     const bool res = data.extractUnit();
     data.startPos += data.ulen;
+    if(res) { skipToPossibleStart(prog, data); }
     return res;
 }
 
@@ -395,28 +607,92 @@ bool RegexLexer::getToken(std::string& out, const std::string& in) {
     return getToken(out, data);
 }
 
+// positions before data.startPos are known not to match, so it's where
+// an aborted call resumes
+static bool abortToken(RegexData& data, RegexData::Status status) {
+    data.status = status;
+    data.stack.clear();
+    data.groups.assign(data.groups.size(), RegexData::Group{ -1, -1 });
+    data.rewindTo(data.startPos);
+    return false;
+}
+
 bool RegexLexer::getToken(const char** start, const char** end, RegexData& data) const {
+    data.status = RegexData::OK;
+    data.hitEnd = false;
     if(data.at == RegexData::LINE_AT_PAST_EOF) { return false; }
 
+    // deadline is checked once per DeadlineCheckSteps steps, as reading
+    // the clock is much slower than a step
+    static const uint64_t DeadlineCheckSteps = 1024;
+    const uint64_t stepLimit = data.stepBudget != 0 ? data.stepBudget : UINT64_MAX;
+    const bool hasDeadline = data.timeBudget.count() > 0;
+    const auto deadline = hasDeadline
+        ? std::chrono::steady_clock::now() + data.timeBudget
+        : std::chrono::steady_clock::time_point{};
+    uint64_t steps = 0;
+
     data.startPos = data.pos;
     data.stack.clear();
-
-    data.groups.insert(data.groups.begin(), this->freeGroupId,
-        RegexData::Group{ -1, -1 });
-
-    data.stack.push_back({nodes[0].get(), 0});
+    data.groups.assign(data.lazyGroups ? 0 : prog.header->groupCount, RegexData::Group{ -1, -1 });
+    data.callStart = data.pos;
+    data.callAt = data.at;
+    data.matchStart = -1;
+#ifdef DLEXER_STATS
+    data.stats.token = {};
+    if(data.profile != nullptr && data.profile->nodes.size() < prog.header->nodeCount) {
+        data.profile->nodes.resize(prog.header->nodeCount, RegexProfile::NodeCounters{});
+    }
+    // the bit-parallel engine has no nodes to count, a profile is taken
+    // of the backtracker
+    const bool profiled = data.profile != nullptr;
+#else
+    const bool profiled = false;
+#endif
+    switch(analysis.engine) {
+    case RegexAnalysis::NFA: return getTokenNfa(start, end, data);
+    case RegexAnalysis::BITPARALLEL: case RegexAnalysis::ONEPASS: {
+        if(!profiled) { return getTokenBits(start, end, data); }
+    } break;
+    case RegexAnalysis::BACKTRACK: break;
+    }
+
+    skipToPossibleStart(prog, data);
+    const Memo memo(prog, data);
+    const size_t limit = data.stackLimit != 0 ? data.stackLimit : SIZE_MAX;
+    size_t reserve = DefaultStackReserve;
+    if(analysis.stackDepth != 0) { reserve = analysis.stackDepth; }
+    reserve = std::min(reserve, limit);
+    if(data.stack.capacity() < reserve) { data.stack.reserve(reserve); }
+    data.stack.push_back({prog.nodes[0].firstChild});
+    memo.pushed(data);
+    STAT_DEPTH(data);
 
     while(true) {
+        if(++steps > stepLimit) {
+            return abortToken(data, RegexData::STEP_BUDGET_EXCEEDED);
+        }
+        if(hasDeadline && steps % DeadlineCheckSteps == 0
+        && std::chrono::steady_clock::now() > deadline) {
+            return abortToken(data, RegexData::DEADLINE_EXCEEDED);
+        }
+
+        STAT_COUNT(data, steps);
         NodeMem& curParent = data.stack.back();
-        Node* cur = curParent.node->children[curParent.firstUnprocessedChild];
+        const int curId = prog.children[curParent.nextChild];
+        const ProgNode& cur = prog.nodes[curId];
+        const bool needsUnit = cur.flags & PROG_NEEDS_UNIT;
+        STAT_NODE(data, curId, steps);
 
         // Fetch unit if needed
-        if(cur->needsUnit) {
+        if(needsUnit) {
             // if can't fetch
             if(data.at == RegexData::LINE_AT_EOF || !data.extractUnit()) { 
-                curParent.firstUnprocessedChild += 1;
+                data.markHitEnd(data.startPos);
+                STAT_NODE(data, curId, fails);
+                curParent.nextChild += 1;
                 // false because eof and we haven't fetched anything
-                if(!popUntilFreeChildren(data, false)) {
+                if(!popUntilFreeChildren(prog, data, memo, false)) {
                     data.at = RegexData::LINE_AT_PAST_EOF;
                     return false;
                 }
@@ -424,36 +700,42 @@ bool RegexLexer::getToken(const char** start, const char** end, RegexData& data)
             }
         }
 
-        const int next = cur->satisfies(data);
+        int next = satisfies(prog, cur, data);
+        bool pruned = false;
+        if(next != -1 && cur.childCount != 0 && memo.visit(data, curId, data.pos)) {
+            next = -1;
+            pruned = true;
+        }
 
         // if not satisfied, revert
         if(next == -1) {
-            cur->revert(data);
-            curParent.firstUnprocessedChild += 1;
-            if(!popUntilFreeChildren(data, cur->needsUnit)) {
+            STAT_NODE(data, curId, fails);
+            if(needsUnit) { STAT_NODE(data, curId, backtracks); }
+            revert(cur, data);
+            memo.reverted(data, cur);
+            if(pruned) { memo.pruned(data, curId, data.pos); }
+            curParent.nextChild += 1;
+            if(!popUntilFreeChildren(prog, data, memo, needsUnit)) {
                 return false;
             }
             continue;
         }
 
         // it's guaranteed that only end node has 0 children
-        if(cur->children.size() == 0) {
-            if(data.startPos == data.pos) {
-                if(data.at == RegexData::LINE_AT_EOF) {
-                    data.at = RegexData::LINE_AT_PAST_EOF;
-                }
-                data.extractUnit();
-                data.startPos = data.pos;
-            }
-
-            *start = data.str + data.startPos;
-            *end = data.str + data.pos;
+        if(cur.childCount == 0) {
+            data.finishMatch(start, end);
+            STAT_TOKEN(data);
             return true;
         }
 
+        if(data.stack.size() >= limit) {
+            return abortToken(data, RegexData::STACK_LIMIT_EXCEEDED);
+        }
         // account current child of current parent
-        curParent.firstUnprocessedChild += 1;
-        data.stack.push_back({cur, next});
+        curParent.nextChild += 1;
+        data.stack.push_back({cur.firstChild + next});
+        memo.pushed(data);
+        STAT_DEPTH(data);
     } // while true
     
     return false;
@@ -468,6 +750,110 @@ bool RegexLexer::getToken(std::string& out, RegexData& data) const {
     return true;
 }
 
+// The first attempt from the match start finds the same match, so the
+// token is matched again from there with captures on. It's bounded by
+// the work of the call that found it, so limits are lifted.
+const std::vector<RegexData::Group>& RegexLexer::getGroups(RegexData& data) const {
+    if(data.matchStart == -1) { return data.groups; }
+
+    const int pos = data.pos;
+    const int startPos = data.startPos;
+    const int ulen = data.ulen;
+    const auto at = data.at;
+    char unit[sizeof(data.unit)];
+    std::memcpy(unit, data.unit, sizeof(unit));
+    const uint64_t stepBudget = data.stepBudget;
+    const auto timeBudget = data.timeBudget;
+    const bool hitEnd = data.hitEnd;
+    const int hitEndStart = data.hitEndStart;
+
+    data.rewindTo(data.matchStart);
+    if(data.matchStart == data.callStart) { data.at = data.callAt; }
+    data.lazyGroups = false;
+    data.stepBudget = 0;
+    data.timeBudget = std::chrono::nanoseconds(0);
+
+    const char* start;
+    const char* end;
+    const bool res = getToken(&start, &end, data);
+    assert(res && "the match must be found again");
+    (void)res;
+
+    data.lazyGroups = true;
+    data.stepBudget = stepBudget;
+    data.timeBudget = timeBudget;
+    data.pos = pos;
+    data.startPos = startPos;
+    data.ulen = ulen;
+    data.at = at;
+    data.hitEnd = hitEnd;
+    data.hitEndStart = hitEndStart;
+    std::memcpy(data.unit, unit, sizeof(unit));
+    return data.groups;
+}
+
+RegexLexer::TokenRange RegexLexer::tokens(std::string_view str) const {
+    return TokenRange(*this, str);
+}
+
+RegexLexer::TokenRange::TokenRange(const RegexLexer& lexer, std::string_view str)
+    : data(str.data(), str.size())
+    , lexer(&lexer)
+    {}
+
+RegexLexer::TokenIterator::TokenIterator(TokenRange& range): range(&range) {
+    token.lexer = range.lexer;
+    token.data = &range.data;
+    ++*this;
+}
+
+RegexLexer::TokenIterator& RegexLexer::TokenIterator::operator++() {
+    const char* start;
+    const char* end;
+    if(!range->lexer->getToken(&start, &end, range->data)) {
+        *this = TokenIterator();
+        return *this;
+    }
+    token.text = std::string_view(start, end - start);
+    return *this;
+}
+
+std::string_view RegexLexer::Token::group(int i) const {
+    return data->view(groups()[i]);
+}
+
+size_t RegexLexer::getTokens(RegexBatch& batch, RegexData& data, size_t maxTokens) const {
+    batch.str = data.str;
+    batch.stride = 1 + prog.header->groupCount;
+    batch.spans.clear();
+    batch.matched.clear();
+
+    size_t count = 0;
+    const char* start;
+    const char* end;
+    while(count < maxTokens && getToken(&start, &end, data)) {
+        appendSpans(start, end, data, batch.spans, batch.matched);
+        count++;
+    }
+    return count;
+}
+
+// a group that didn't match is an empty span at the token start
+void RegexLexer::appendSpans(const char* start, const char* end, RegexData& data,
+    std::vector<RegexBatch::Span>& spans, std::vector<uint8_t>& matched) const
+{
+    const uint32_t tokenStart = start - data.str;
+    spans.push_back({ tokenStart, static_cast<uint32_t>(end - data.str) });
+    matched.push_back(1);
+    for(const RegexData::Group& g: getGroups(data)) {
+        const bool m = g.start != -1 && g.end != -1;
+        spans.push_back(m
+            ? RegexBatch::Span{ static_cast<uint32_t>(g.start), static_cast<uint32_t>(g.end) }
+            : RegexBatch::Span{ tokenStart, tokenStart });
+        matched.push_back(m);
+    }
+}
+
 void RegexLexer::adaptStackToSiblingOr(Children_t& stack, int sibAt) {
     assert(isSuperiorNodeOfType<OrNode>(OrNode::Presedence, stack) != -1);
     appendNode(stack, createNode<EndNode>(), true);
@@ -502,8 +888,10 @@ int findLastSuperiorTo(dtl::Node& node, const dtl::Children_t& stack) {
 
 /***********************************  NODES  *******************************/
 
+// looks at the string rather than at unit, so that the state after
+// returnUnit() is the same as after extractUnit() to that position
 bool RegexData::isCurOrNextNewLine() const {
-    if(ulen == 1 && unit[0] == '\n') { return true; }
+    if(pos > 0 && str[pos - 1] == '\n') { return true; }
     if(unitLength(str[pos]) == 1 && str[pos] == '\n') { return true; }
     return false;
 }
@@ -516,19 +904,75 @@ void RegexData::updateAt() {
     else { at = LINE_AT_MID; }
 }
 
+RegexStats RegexData::getStats() const {
+#ifdef DLEXER_STATS
+    return stats;
+#else
+    return RegexStats{};
+#endif
+}
+
+void RegexData::resetStats() {
+#ifdef DLEXER_STATS
+    stats = {};
+#endif
+}
+
+void RegexData::setProfile(RegexProfile* profile) {
+#ifdef DLEXER_STATS
+    this->profile = profile;
+#endif
+}
+
 int RegexData::returnUnit() {
     const int ulen = unitLengthLast(str + pos - 1);
     pos -= ulen;
+    STAT_COUNT(*this, backtracks);
 
     updateAt();
 
     return ulen;
 }
 
+void RegexData::finishMatch(const char** start, const char** end) {
+    if(lazyGroups) { matchStart = startPos; }
+    if(startPos == pos) {
+        // at is LINE_AT_START rather than LINE_AT_EOF in an empty string
+        if(pos == strLen) {
+            // more input would give the same empty match and then the next one
+            markHitEnd(startPos);
+            at = LINE_AT_PAST_EOF;
+        }
+        extractUnit();
+        startPos = pos;
+    }
+
+    *start = str + startPos;
+    *end = str + pos;
+}
+
+void RegexData::markHitEnd(int start) {
+    if(!hitEnd || start < hitEndStart) { hitEndStart = start; }
+    hitEnd = true;
+}
+
+void RegexData::rewindTo(int pos) {
+    if(pos == 0) {
+        this->pos = 0;
+        ulen = 0;
+        at = LINE_AT_START;
+        return;
+    }
+
+    this->pos = pos - unitLengthLast(str + pos - 1);
+    extractUnit();
+}
+
 bool RegexData::extractUnit() {
     if(pos < strLen) {
         ulen = extractUnitStr(unit, str + pos);
         pos += ulen;
+        STAT_COUNT(*this, unitsFetched);
 
         updateAt();
     } else {
@@ -542,13 +986,6 @@ UnitNode::UnitNode(const char* unitPtr, int ulen): ulen(ulen) {
     std::memcpy(this->unit, unitPtr, sizeof(unit));
 }
 
-int UnitNode::satisfies(RegexData& data) const {
-    if((data.ulen == this->ulen) & (std::memcmp(this->unit, data.unit, data.ulen) == 0)) {
-        return 0;
-    }
-    return -1;
-}
-
 void UnitNode::adaptChild(Children_t &stack, Node &node, int at) {
     // assuming that unit node has lowest pres
     assert(at == stack.size() && "child of unit node must be only appended");
@@ -567,23 +1004,6 @@ OrNode::OrNode(bool neg): NodeCRTP(true, neg), isNegative(neg) {}
 
 OrNode::OrNode(): OrNode(false) {}
 
-int OrNode::satisfies(RegexData& data) const {
-    if(!isNegative) { 
-        assert(!this->needsUnit);
-        return 0; 
-    }
-    assert(this->needsUnit);
-    assert(children.size() > 1);
-
-    for(int i = 0; i < children.size() - 1; ++i) {
-        if(children[i]->satisfies(data) != -1) { 
-            return -1; 
-        }
-    }
-
-    return children.size() - 1;
-}
-
 void OrNode::adaptEndGroupNode(GroupNode& node, Node& curParent, std::vector<Node*>& visit) {
     const auto found = 
         std::find(visit.cbegin(), visit.cend(), &curParent) != visit.cend();
@@ -653,35 +1073,6 @@ void GroupNode::clearStackBetweenPaired(Children_t& stack) const {
     stack.back() = nonConstThis;
 }
 
-int GroupNode::satisfies(RegexData& data) const {
-    assert(groupId < static_cast<int>(data.groups.size()));
-
-    if(!capture) { return 0; }
-
-    assert(groupId >= 0 && "only not capturing group may have id < 0");
-
-    if(isEnd()) {
-        data.groups[groupId].end = data.pos;
-    } else {
-        data.groups[groupId].start = data.pos;
-    }
-    return 0; 
-}
-
-void GroupNode::revert(RegexData& data) const {
-    assert(groupId < static_cast<int>(data.groups.size()));
-
-    if(!capture) { return; }
-
-    assert(groupId >= 0 && "only not capturing group may have id < 0");
-
-    if(isEnd()) {
-        data.groups[groupId].end = -1;
-    } else {
-        data.groups[groupId].start = -1;
-    }
-}
-
 void GroupNode::lowerPresedence() {
     assert(paired != nullptr);
 
@@ -717,8 +1108,6 @@ void GroupNode::adaptChild(Children_t &stack, Node &node, int at) {
     }
 }
 
-int StartNode::satisfies(RegexData& data) const { return -1; }
-
 void StartNode::adaptChild(Children_t &stack, Node &node, int at) {
     assert(at == 1 && "start node only adapts at stack pos == 1");
     stack.resize(at);
@@ -735,8 +1124,6 @@ void StartNode::adaptChild(Children_t &stack, Node &node, int at) {
 
 RepeatNode::RepeatNode(Mode mode): mode(mode) {}
 
-int RepeatNode::satisfies(RegexData& data) const { return 0; }
-
 void RepeatNode::adaptChild(Children_t &stack, Node &node, int at) {
     assert(this->children.size() == 1);
 
@@ -775,8 +1162,6 @@ void RepeatNode::adaptChild(Children_t &stack, Node &node, int at) {
 
 EndNode::EndNode() {}
 
-int EndNode::satisfies(RegexData& data) const { return 0; }
-
 void EndNode::adaptChild(Children_t &stack, Node &node, int at) {
     std::cerr << "ERROR: attempt to push child to end node\n";
     std::exit(1);
@@ -784,11 +1169,6 @@ void EndNode::adaptChild(Children_t &stack, Node &node, int at) {
 
 AtStartNode::AtStartNode() {}
 
-int AtStartNode::satisfies(RegexData& data) const { 
-    // matches both start and end (where end is line or file end)
-    return -1 * (data.at == RegexData::LINE_AT_MID);
-}
-
 void AtStartNode::adaptChild(Children_t &stack, Node &node, int at) {
     assert(at == stack.size() && "AtStartNode's child must be appended");
 
@@ -798,11 +1178,6 @@ void AtStartNode::adaptChild(Children_t &stack, Node &node, int at) {
 
 AtEndNode::AtEndNode() {}
 
-int AtEndNode::satisfies(RegexData& data) const { 
-    return -1 * !(data.at == RegexData::LINE_AT_EOF 
-        || data.at == RegexData::LINE_AT_END);
-}
-
 void AtEndNode::adaptChild(Children_t &stack, Node &node, int at) {
     assert(at == stack.size() && "AtEndNode's child must be appended");
 
@@ -831,15 +1206,6 @@ RangeNode::RangeNode(const char* start, const char* end, int startlen, int endle
     std::memcpy(this->end, end, sizeof(this->end));
 }
 
-int RangeNode::satisfies(RegexData& data) const {
-    assert(startlen == endlen);
-
-    if(data.ulen != startlen
-    || std::memcmp(start, data.unit, startlen) > 0
-    || std::memcmp(end, data.unit, startlen) < 0) { return -1; }
-    return 0;
-}
-
 void RangeNode::adaptChild(Children_t &stack, Node &node, int at) {
     assert(at == stack.size() && "child of RangeNode must be only appended");
 
@@ -855,10 +1221,6 @@ void RangeNode::adaptChild(Children_t &stack, Node &node, int at) {
 
 FailNode::FailNode() {}
 
-int FailNode::satisfies(RegexData& data) const { 
-    return -1;
-}
-
 void FailNode::adaptChild(Children_t &stack, Node &node, int at) {
     assert(at == stack.size() && "FailNode's child must be appended");
 
@@ -1180,24 +1542,19 @@ private:
 };
 
 static std::string getCPrelude() {
-    static const char* path = "templates/regex/prelude.c";
-    std::ifstream ifs(path);
-    return std::string(
-        (std::istreambuf_iterator<char>(ifs)),
-        (std::istreambuf_iterator<char>())
-    );
+    return readTemplate("templates/regex/prelude.c");
 }
 
 static std::string getCPost() {
-    static const char* path = "templates/regex/post.c";
-    std::ifstream ifs(path);
-    return std::string(
-        (std::istreambuf_iterator<char>(ifs)),
-        (std::istreambuf_iterator<char>())
-    );
+    return readTemplate("templates/regex/post.c");
 }
 
 void RegexLexer::generateCProgram(const std::string& path) {
+    if(nodes.empty()) {
+        std::cerr << "ERROR: C program can't be generated from regex image\n";
+        return;
+    }
+
     std::string out = getCPrelude();
     std::string mid;
 
@@ -0,0 +1,388 @@
+#include <dlexer/regex.hpp>
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+namespace dlexer {
+
+namespace dtl {
+
+// Exponential backtracking needs exponential degree of ambiguity: a state
+// with two different paths around a loop on the same input. On the
+// automaton whose states are consuming nodes, it means that the product
+// of the automaton with itself has a strongly connected component with
+// a diagonal state (q, q) and either a non-diagonal state (p, r) or an
+// edge (q, q) -> (s, s) standing for two different epsilon paths.
+
+static const uint64_t MaxProductEdges = 1 << 20;
+
+static bool isConsuming(const ProgNode& n) {
+    return n.kind == PROG_UNIT || n.kind == PROG_RANGE
+        || (n.kind == PROG_OR && (n.flags & PROG_NEGATIVE));
+}
+
+struct Succ {
+    uint32_t node;
+    // number of epsilon paths to the node, at most 2
+    uint8_t paths;
+};
+
+struct ClosureBuilder {
+    const Program& prog;
+    std::vector<uint8_t> paths;
+    std::vector<uint8_t> onStack;
+    std::vector<uint32_t> touched;
+
+    ClosureBuilder(const Program& prog)
+        : prog(prog)
+        , paths(prog.header->nodeCount, 0)
+        , onStack(prog.header->nodeCount, 0)
+        {}
+
+    // a node met again while on stack lies on an epsilon loop, so there
+    // are infinitely many paths to everything after it
+    void go(uint32_t id, int add) {
+        const uint8_t old = paths[id];
+        const uint8_t now = onStack[id] ? 2 : std::min(2, old + add);
+        if(now == old) { return; }
+
+        if(old == 0) { touched.push_back(id); }
+        paths[id] = now;
+
+        const ProgNode& n = prog.nodes[id];
+        if(isConsuming(n)) { return; }
+
+        onStack[id]++;
+        for(uint32_t i = 0; i < n.childCount; ++i) {
+            go(prog.children[n.firstChild + i], now - old);
+        }
+        onStack[id]--;
+    }
+
+    std::vector<Succ> build(uint32_t from) {
+        const ProgNode& n = prog.nodes[from];
+        // negative OrNode checks all children but continues with the last one
+        const uint32_t first = n.kind == PROG_OR && (n.flags & PROG_NEGATIVE) ? n.childCount - 1 : 0;
+        for(uint32_t i = first; i < n.childCount; ++i) {
+            go(prog.children[n.firstChild + i], 1);
+        }
+
+        std::vector<Succ> res;
+        for(const uint32_t id: touched) {
+            if(isConsuming(prog.nodes[id])) { res.push_back({id, paths[id]}); }
+            paths[id] = 0;
+        }
+        touched.clear();
+        return res;
+    }
+};
+
+static bool unitInRange(const unsigned char* u, const ProgNode& r) {
+    return std::memcmp(r.a, u, r.ulen) <= 0 && std::memcmp(u, r.b, r.ulen) <= 0;
+}
+
+// whether a negative OrNode excludes every unit of the node
+static bool excludes(const Program& prog, const ProgNode& neg, const ProgNode& n) {
+    for(uint32_t i = 0; i + 1 < neg.childCount; ++i) {
+        const ProgNode& ex = prog.child(neg, i);
+        if(ex.ulen != n.ulen) { continue; }
+
+        if(n.kind == PROG_UNIT) {
+            if(ex.kind == PROG_UNIT && std::memcmp(ex.a, n.a, n.ulen) == 0) { return true; }
+            if(ex.kind == PROG_RANGE && unitInRange(n.a, ex)) { return true; }
+        } else if(ex.kind == PROG_RANGE && unitInRange(n.a, ex) && unitInRange(n.b, ex)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// whether some unit may satisfy both nodes
+static bool intersects(const Program& prog, const ProgNode& l, const ProgNode& r) {
+    if(l.kind == PROG_OR) { return r.kind == PROG_OR || !excludes(prog, l, r); }
+    if(r.kind == PROG_OR) { return !excludes(prog, r, l); }
+    if(l.ulen != r.ulen) { return false; }
+
+    if(l.kind == PROG_UNIT && r.kind == PROG_UNIT) { return std::memcmp(l.a, r.a, l.ulen) == 0; }
+    if(l.kind == PROG_UNIT) { return unitInRange(l.a, r); }
+    if(r.kind == PROG_UNIT) { return unitInRange(r.a, l); }
+    return std::memcmp(l.a, r.b, l.ulen) <= 0 && std::memcmp(r.a, l.b, l.ulen) <= 0;
+}
+
+static uint32_t features(const Program& prog) {
+    uint32_t res = 0;
+    for(uint32_t i = 0; i < prog.header->nodeCount; ++i) {
+        const ProgNode& n = prog.nodes[i];
+        switch(n.kind) {
+        case PROG_REPEAT: if(n.flags & PROG_LAZY) { res |= RegexAnalysis::LAZY; } break;
+        case PROG_GROUP: if(n.flags & PROG_CAPTURE) { res |= RegexAnalysis::CAPTURES; } break;
+        case PROG_AT_START: case PROG_AT_END: res |= RegexAnalysis::ANCHORS; break;
+        case PROG_OR: if(n.flags & PROG_NEGATIVE) { res |= RegexAnalysis::NEGATED_CLASSES; } break;
+        default: break;
+        }
+    }
+    return res;
+}
+
+struct Product {
+    const Program& prog;
+    std::vector<std::vector<Succ>> succ;
+    // product state is key = l * nodeCount + r
+    uint64_t nodeCount;
+    std::unordered_map<uint64_t, uint32_t> index;
+    std::vector<uint64_t> keys;
+    std::vector<std::vector<uint32_t>> edges;
+    // edges (q, q) -> (s, s) for two epsilon paths from q to s
+    std::vector<std::pair<uint32_t, uint32_t>> splitEdges;
+    uint64_t edgeCount = 0;
+
+    Product(const Program& prog): prog(prog), succ(prog.header->nodeCount), nodeCount(prog.header->nodeCount) {}
+
+    uint32_t stateOf(uint64_t key, std::vector<uint32_t>& pending) {
+        auto it = index.find(key);
+        if(it != index.end()) { return it->second; }
+
+        const uint32_t id = keys.size();
+        index.emplace(key, id);
+        keys.push_back(key);
+        edges.emplace_back();
+        pending.push_back(id);
+        return id;
+    }
+
+    // returns false if the product is too big
+    bool build() {
+        ClosureBuilder closure(prog);
+        std::vector<bool> built(nodeCount, false);
+        auto succOf = [&](uint32_t id) -> const std::vector<Succ>& {
+            if(!built[id]) {
+                succ[id] = closure.build(id);
+                built[id] = true;
+            }
+            return succ[id];
+        };
+
+        std::vector<uint32_t> pending;
+        stateOf(0, pending);
+        while(!pending.empty()) {
+            const uint32_t from = pending.back();
+            pending.pop_back();
+
+            const uint32_t l = keys[from] / nodeCount;
+            const uint32_t r = keys[from] % nodeCount;
+            const std::vector<Succ>& ls = succOf(l);
+            const std::vector<Succ>& rs = succOf(r);
+            for(const Succ& ln: ls) {
+                for(const Succ& rn: rs) {
+                    if(++edgeCount > MaxProductEdges) { return false; }
+                    if(!intersects(prog, prog.nodes[ln.node], prog.nodes[rn.node])) { continue; }
+
+                    const uint32_t to = stateOf(ln.node * nodeCount + rn.node, pending);
+                    edges[from].push_back(to);
+                    if(l == r && ln.node == rn.node && ln.paths > 1) {
+                        splitEdges.push_back({from, to});
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    // iterative Tarjan's algorithm
+    std::vector<uint32_t> components() const {
+        const uint32_t count = keys.size();
+        const uint32_t none = UINT32_MAX;
+        std::vector<uint32_t> comp(count, none);
+        std::vector<uint32_t> order(count, none);
+        std::vector<uint32_t> low(count, 0);
+        std::vector<uint32_t> stack;
+        std::vector<std::pair<uint32_t, uint32_t>> calls;
+        uint32_t nextOrder = 0;
+        uint32_t nextComp = 0;
+
+        for(uint32_t root = 0; root < count; ++root) {
+            if(order[root] != none) { continue; }
+
+            calls.push_back({root, 0});
+            while(!calls.empty()) {
+                const uint32_t v = calls.back().first;
+                uint32_t& edge = calls.back().second;
+                if(edge == 0) {
+                    order[v] = low[v] = nextOrder++;
+                    stack.push_back(v);
+                }
+
+                if(edge < edges[v].size()) {
+                    const uint32_t w = edges[v][edge++];
+                    if(order[w] == none) {
+                        calls.push_back({w, 0});
+                    } else if(comp[w] == none) {
+                        low[v] = std::min(low[v], order[w]);
+                    }
+                    continue;
+                }
+
+                if(low[v] == order[v]) {
+                    uint32_t w;
+                    do {
+                        w = stack.back();
+                        stack.pop_back();
+                        comp[w] = nextComp;
+                    } while(w != v);
+                    nextComp++;
+                }
+                calls.pop_back();
+                if(!calls.empty()) {
+                    const uint32_t parent = calls.back().first;
+                    low[parent] = std::min(low[parent], low[v]);
+                }
+            }
+        }
+        return comp;
+    }
+};
+
+RegexAnalysis analyzeProgram(const Program& prog) {
+    RegexAnalysis res;
+    res.features = features(prog);
+
+    Product p(prog);
+    if(!p.build()) {
+        res.features |= RegexAnalysis::UNANALYZED;
+        return res;
+    }
+
+    const std::vector<uint32_t> comp = p.components();
+    auto onLoop = [&](uint32_t from, uint32_t to) { return comp[from] == comp[to]; };
+    auto diagonal = [&](uint32_t s) { return p.keys[s] / p.nodeCount == p.keys[s] % p.nodeCount; };
+
+    // component -> its diagonal state
+    std::unordered_map<uint32_t, uint32_t> diag;
+    for(uint32_t s = 0; s < p.keys.size(); ++s) {
+        if(diagonal(s) && s != 0) { diag.emplace(comp[s], s); }
+    }
+
+    auto report = [&](uint32_t s) {
+        res.features |= RegexAnalysis::EXPONENTIAL;
+        res.ambiguousPos = prog.nodes[p.keys[s] % p.nodeCount].patternPos;
+        return res;
+    };
+
+    for(const auto& e: p.splitEdges) {
+        if(onLoop(e.first, e.second)) { return report(e.second); }
+    }
+    for(uint32_t s = 0; s < p.keys.size(); ++s) {
+        if(diagonal(s)) { continue; }
+        auto it = diag.find(comp[s]);
+        if(it != diag.end()) { return report(it->second); }
+    }
+    return res;
+}
+
+// The stack holds the StartNode and every node on the path to the one
+// being tried, except EndNode, which ends the token.
+size_t stackDepth(const Program& prog) {
+    const uint32_t nodeCount = prog.header->nodeCount;
+    static const uint32_t Unknown = UINT32_MAX;
+    static const uint32_t OnPath = UINT32_MAX - 1;
+    // longest path of nodes starting with the node
+    std::vector<uint32_t> depth(nodeCount, Unknown);
+    std::vector<std::pair<uint32_t, uint32_t>> calls;
+
+    calls.push_back({0, 0});
+    depth[0] = OnPath;
+    while(!calls.empty()) {
+        const uint32_t id = calls.back().first;
+        uint32_t& child = calls.back().second;
+        const ProgNode& n = prog.nodes[id];
+
+        if(child < n.childCount) {
+            const uint32_t c = prog.children[n.firstChild + child++];
+            if(depth[c] == OnPath) { return 0; }
+            if(depth[c] == Unknown) {
+                depth[c] = OnPath;
+                calls.push_back({c, 0});
+            }
+            continue;
+        }
+
+        uint32_t longest = 0;
+        for(uint32_t i = 0; i < n.childCount; ++i) {
+            longest = std::max(longest, depth[prog.children[n.firstChild + i]]);
+        }
+        depth[id] = n.kind == PROG_END ? 0 : longest + 1;
+        calls.pop_back();
+    }
+    return depth[0];
+}
+
+// Token length is the longest way to EndNode. A consuming node reads
+// one unit and an anchor looks at the unit after its position, so every
+// attempt reads at most `read` units from where it starts. The match is
+// at least `minLen` units long, which leaves read - minLen units the
+// matcher may look at past the end of a token; attempts from earlier
+// positions start at least a unit before it.
+void lengthBounds(const Program& prog, RegexAnalysis& res) {
+    static const size_t NoEnd = SIZE_MAX;
+    const uint32_t nodeCount = prog.header->nodeCount;
+    res.maxTokenLength = RegexAnalysis::Unbounded;
+    res.maxLookahead = RegexAnalysis::Unbounded;
+
+    // from the position before the node: units read and the longest and
+    // shortest way to EndNode, minLen is NoEnd if there is none
+    std::vector<size_t> read(nodeCount, 0);
+    std::vector<size_t> maxLen(nodeCount, 0);
+    std::vector<size_t> minLen(nodeCount, NoEnd);
+    std::vector<uint8_t> state(nodeCount, 0); // 1 on path, 2 done
+    std::vector<std::pair<uint32_t, uint32_t>> calls;
+
+    // negative OrNode checks all children but continues with the last one
+    auto firstChild = [&](const ProgNode& n) {
+        return isConsuming(n) && n.kind == PROG_OR ? n.childCount - 1 : 0;
+    };
+
+    calls.push_back({0, firstChild(prog.nodes[0])});
+    state[0] = 1;
+    while(!calls.empty()) {
+        const uint32_t id = calls.back().first;
+        uint32_t& child = calls.back().second;
+        const ProgNode& n = prog.nodes[id];
+
+        if(child < n.childCount) {
+            const uint32_t c = prog.children[n.firstChild + child++];
+            if(state[c] == 1) { return; }
+            if(state[c] == 0) {
+                state[c] = 1;
+                calls.push_back({c, firstChild(prog.nodes[c])});
+            }
+            continue;
+        }
+
+        if(n.kind == PROG_END) { minLen[id] = 0; }
+        for(uint32_t i = firstChild(n); i < n.childCount; ++i) {
+            const uint32_t c = prog.children[n.firstChild + i];
+            read[id] = std::max(read[id], read[c]);
+            if(minLen[c] == NoEnd) { continue; }
+            maxLen[id] = std::max(maxLen[id], maxLen[c]);
+            minLen[id] = std::min(minLen[id], minLen[c]);
+        }
+
+        if(isConsuming(n)) {
+            read[id] += 1;
+            maxLen[id] += 1;
+            if(minLen[id] != NoEnd) { minLen[id] += 1; }
+        }
+        if(n.kind == PROG_AT_START || n.kind == PROG_AT_END) { read[id] = std::max<size_t>(read[id], 1); }
+
+        state[id] = 2;
+        calls.pop_back();
+    }
+
+    const bool matches = minLen[0] != NoEnd;
+    res.maxTokenLength = matches ? maxLen[0] : 0;
+    res.maxLookahead = read[0] - (matches ? minLen[0] : 0);
+}
+
+} // namespace dtl
+
+} // namespace dlexer
@@ -0,0 +1,414 @@
+#include <dlexer/regex.hpp>
+#include <dlexer/common.hpp>
+#include "regexstats.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace dlexer {
+
+namespace dtl {
+
+static const int MaxBitStates = 64;
+static const uint64_t NoUnitKey = UINT64_MAX;
+
+// units of the same length compare as big-endian numbers, like memcmp()
+static uint64_t unitKey(const unsigned char* unit, int ulen) {
+    uint64_t key = ulen;
+    for(int i = 0; i < 4; ++i) {
+        key = (key << 8) | (i < ulen ? unit[i] : 0);
+    }
+    return key;
+}
+
+static bool accepts(const Program& prog, const ProgNode& n, uint64_t key) {
+    switch(n.kind) {
+    case PROG_UNIT: return key == unitKey(n.a, n.ulen);
+    case PROG_RANGE: return unitKey(n.a, n.ulen) <= key && key <= unitKey(n.b, n.ulen);
+    case PROG_OR: {
+        // negative: accepts any unit its children but the last one don't
+        for(uint32_t i = 0; i + 1 < n.childCount; ++i) {
+            if(accepts(prog, prog.child(n, i), key)) { return false; }
+        }
+        return true;
+    }
+    default: return false;
+    }
+}
+
+static int lowestBit(uint64_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(mask);
+#else
+    int bit = 0;
+    while(!(mask & 1)) { mask >>= 1; bit++; }
+    return bit;
+#endif
+}
+
+static bool isConsuming(const ProgNode& n) {
+    return n.kind == PROG_UNIT || n.kind == PROG_RANGE
+        || (n.kind == PROG_OR && (n.flags & PROG_NEGATIVE));
+}
+
+struct TraceEvent {
+    enum Kind: uint8_t { SET, CLEAR, REACH, END } kind;
+    // field for SET and CLEAR, state bit for REACH
+    uint8_t arg;
+};
+
+// Replays the backtracker walking epsilon nodes of a state: capture group
+// writes, reverts of groups it leaves, consuming nodes and EndNodes in
+// the order it meets them.
+struct BitBuilder {
+    static const size_t MaxTraceEvents = 1 << 12;
+
+    const Program& prog;
+    const std::vector<int>& bitOf;
+    std::vector<uint8_t> onStack;
+    std::vector<TraceEvent> events;
+    bool fits = true;
+
+    BitBuilder(const Program& prog, const std::vector<int>& bitOf)
+        : prog(prog)
+        , bitOf(bitOf)
+        , onStack(prog.header->nodeCount, 0)
+        {}
+
+    void go(uint32_t id) {
+        if(events.size() > MaxTraceEvents) {
+            fits = false;
+            return;
+        }
+
+        const ProgNode& n = prog.nodes[id];
+        if(isConsuming(n)) {
+            events.push_back({TraceEvent::REACH, static_cast<uint8_t>(bitOf[id])});
+            return;
+        }
+
+        switch(n.kind) {
+        case PROG_END: events.push_back({TraceEvent::END, 0}); return;
+        case PROG_FAIL: return;
+        case PROG_AT_START: case PROG_AT_END: case PROG_START: fits = false; return;
+        default: break;
+        }
+
+        if(onStack[id]) {
+            fits = false;
+            return;
+        }
+        const bool capture = n.kind == PROG_GROUP && (n.flags & PROG_CAPTURE);
+        const uint8_t field = capture ? 2 * n.groupId + ((n.flags & PROG_IS_END) ? 1 : 0) : 0;
+
+        if(capture) { events.push_back({TraceEvent::SET, field}); }
+        onStack[id] = 1;
+        for(uint32_t i = 0; i < n.childCount && fits; ++i) {
+            go(prog.children[n.firstChild + i]);
+        }
+        onStack[id] = 0;
+        if(capture) { events.push_back({TraceEvent::CLEAR, field}); }
+    }
+
+    void trace(const ProgNode& from) {
+        events.clear();
+        // negative OrNode checks all children but continues with the last one
+        const bool negative = from.kind == PROG_OR && (from.flags & PROG_NEGATIVE);
+        for(uint32_t i = negative ? from.childCount - 1 : 0; i < from.childCount && fits; ++i) {
+            go(prog.children[from.firstChild + i]);
+        }
+    }
+
+    // a state met again is tried later from the same position, so it
+    // can't match anything the first one didn't
+    BitProgram::State state() const {
+        BitProgram::State res{};
+        for(const TraceEvent& e: events) {
+            switch(e.kind) {
+            case TraceEvent::REACH: {
+                const uint64_t bit = uint64_t(1) << e.arg;
+                if(!res.final) { res.beforeEnd |= bit; }
+                res.follow |= bit;
+            } break;
+            case TraceEvent::END: res.final = true; break;
+            default: res.touched |= uint64_t(1) << e.arg; break;
+            }
+        }
+        return res;
+    }
+
+    size_t find(TraceEvent::Kind kind, int arg = 0) const {
+        for(size_t i = 0; i < events.size(); ++i) {
+            if(events[i].kind == kind && (kind != TraceEvent::REACH || events[i].arg == arg)) { return i; }
+        }
+        return events.size();
+    }
+
+    // the last write of every field in events [from, to)
+    void addOps(BitTables& bits, size_t from, size_t to) const {
+        int8_t last[64];
+        std::memset(last, -1, sizeof(last));
+        for(size_t i = from; i < to; ++i) {
+            const TraceEvent& e = events[i];
+            if(e.kind == TraceEvent::SET || e.kind == TraceEvent::CLEAR) { last[e.arg] = e.kind == TraceEvent::SET; }
+        }
+        for(int f = 0; f < 64; ++f) {
+            if(last[f] != -1) { bits.groupOps.push_back({static_cast<uint8_t>(f), static_cast<uint8_t>(last[f] == 1)}); }
+        }
+        bits.opBounds.push_back(bits.groupOps.size());
+    }
+
+    void addStateOps(BitTables& bits, BitProgram::State& s) const {
+        s.ops = bits.opBounds.size() - 1;
+        const size_t end = find(TraceEvent::END);
+
+        std::vector<int> follow;
+        for(uint64_t m = s.follow; m != 0; m &= m - 1) { follow.push_back(lowestBit(m)); }
+        for(const int bit: follow) { addOps(bits, 0, find(TraceEvent::REACH, bit)); }
+
+        // the match ends here once everything tried after the state
+        // failed and reverted the fields it touched; the last try of the
+        // follow state splits the writes into ones before and after that
+        std::vector<size_t> lastTry;
+        for(const int bit: follow) {
+            size_t last = 0;
+            for(size_t i = 0; i < end; ++i) {
+                if(events[i].kind == TraceEvent::REACH && events[i].arg == bit) { last = i; }
+            }
+            lastTry.push_back(last);
+        }
+        for(const size_t last: lastTry) { addOps(bits, 0, last); }
+        for(const size_t last: lastTry) { addOps(bits, last, end); }
+        addOps(bits, 0, end);
+    }
+};
+
+bool BitTables::build(const Program& prog) {
+    states.clear();
+    classStarts.clear();
+    classMasks.clear();
+    opBounds.assign(1, 0);
+    groupOps.clear();
+
+    const uint32_t nodeCount = prog.header->nodeCount;
+    if(prog.header->groupCount > 32) { return false; }
+
+    std::vector<int> bitOf(nodeCount, -1);
+    std::vector<uint32_t> consuming;
+    for(uint32_t i = 0; i < nodeCount; ++i) {
+        if(!isConsuming(prog.nodes[i])) { continue; }
+        if(consuming.size() == MaxBitStates) { return false; }
+        bitOf[i] = consuming.size();
+        consuming.push_back(i);
+    }
+
+    BitBuilder b(prog, bitOf);
+    auto addState = [&](const ProgNode& n) {
+        b.trace(n);
+        states.push_back(b.state());
+        if(prog.header->groupCount != 0) { b.addStateOps(*this, states.back()); }
+    };
+    for(const uint32_t id: consuming) { addState(prog.nodes[id]); }
+    addState(prog.nodes[0]);
+    if(!b.fits) { return false; }
+
+    // bounds of units accepted by any node split all units into classes;
+    // units inside negative OrNodes are bounds of the node itself
+    classStarts.push_back(0);
+    auto addBounds = [&](const ProgNode& n) {
+        if(n.kind == PROG_UNIT) {
+            classStarts.push_back(unitKey(n.a, n.ulen));
+            classStarts.push_back(unitKey(n.a, n.ulen) + 1);
+        } else if(n.kind == PROG_RANGE) {
+            classStarts.push_back(unitKey(n.a, n.ulen));
+            classStarts.push_back(unitKey(n.b, n.ulen) + 1);
+        }
+    };
+    for(const uint32_t id: consuming) {
+        const ProgNode& n = prog.nodes[id];
+        if(n.kind != PROG_OR) {
+            addBounds(n);
+            continue;
+        }
+        for(uint32_t i = 0; i + 1 < n.childCount; ++i) { addBounds(prog.child(n, i)); }
+    }
+    std::sort(classStarts.begin(), classStarts.end());
+    classStarts.erase(std::unique(classStarts.begin(), classStarts.end()), classStarts.end());
+
+    for(const uint64_t key: classStarts) {
+        uint64_t mask = 0;
+        for(size_t bit = 0; bit < consuming.size(); ++bit) {
+            if(accepts(prog, prog.nodes[consuming[bit]], key)) { mask |= uint64_t(1) << bit; }
+        }
+        classMasks.push_back(mask);
+    }
+    // units longer than 4 bytes can't be accepted by anything
+    classStarts.push_back(NoUnitKey);
+    classMasks.push_back(0);
+
+    // priority is only kept when every unit leads to a single state
+    for(const BitProgram::State& s: states) {
+        for(const uint64_t mask: classMasks) {
+            const uint64_t next = s.follow & mask;
+            if(next & (next - 1)) { return false; }
+        }
+    }
+
+    BitProgram view;
+    view.classStarts = classStarts.data();
+    view.classCount = classStarts.size();
+    for(int c = 0; c < 256; ++c) {
+        const unsigned char u = c;
+        byteClass[c] = view.classOf(reinterpret_cast<const char*>(&u), 1);
+    }
+    return true;
+}
+
+int BitProgram::classOf(const char* unit, int ulen) const {
+    const uint64_t key = ulen <= 4
+        ? unitKey(reinterpret_cast<const unsigned char*>(unit), ulen)
+        : NoUnitKey;
+    return std::upper_bound(classStarts, classStarts + classCount, key) - classStarts - 1;
+}
+
+} // namespace dtl
+
+using namespace dtl;
+
+static void setField(std::vector<RegexData::Group>& groups, int field, int value) {
+    RegexData::Group& g = groups[field / 2];
+    (field % 2 ? g.end : g.start) = value;
+}
+
+static void applyOps(const BitProgram& bits, uint32_t range, std::vector<RegexData::Group>& groups, int pos) {
+    for(uint32_t i = bits.opBounds[range]; i < bits.opBounds[range + 1]; ++i) {
+        const BitProgram::GroupOp& op = bits.groupOps[i];
+        setField(groups, op.field, op.set ? pos : -1);
+    }
+}
+
+static int popCount(uint64_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(mask);
+#else
+    int res = 0;
+    for(; mask != 0; mask &= mask - 1) { res++; }
+    return res;
+#endif
+}
+
+// With one state at a time, a final state ends the match unless the next
+// unit goes to a state tried before the end; then the position is kept
+// to fall back to, as the backtracker would. Groups are written as the
+// backtracker would leave them: at the fallback, every field touched
+// after it is reverted.
+bool RegexLexer::getTokenBits(const char** start, const char** end, RegexData& data) const {
+    static const uint64_t DeadlineCheckSteps = 1024;
+    const uint64_t stepLimit = data.stepBudget != 0 ? data.stepBudget : UINT64_MAX;
+    const bool hasDeadline = data.timeBudget.count() > 0;
+    const auto deadline = hasDeadline
+        ? std::chrono::steady_clock::now() + data.timeBudget
+        : std::chrono::steady_clock::time_point{};
+    uint64_t steps = 0;
+
+    const int strLen = static_cast<int>(data.strLen);
+    const char* str = data.str;
+    const int callStart = data.pos;
+    const bool captures = !data.groups.empty();
+    int from = data.pos;
+    int matchEnd = -1;
+
+    while(true) {
+        if(!prog.header->anyFirstByte) {
+            while(from < strLen && !prog.canStartWith(str[from])) { from += unitLength(str[from]); }
+            from = std::min(from, strLen);
+        }
+
+        int state = bits.start();
+        int pos = from;
+        int fallback = -1;
+        int fallbackState = 0;
+        int fallbackRank = 0;
+        // fields touched after the fallback
+        uint64_t touched = 0;
+        if(captures) { data.groups.assign(data.groups.size(), RegexData::Group{ -1, -1 }); }
+
+        while(true) {
+            if(++steps > stepLimit) { data.status = RegexData::STEP_BUDGET_EXCEEDED; }
+            if(hasDeadline && steps % DeadlineCheckSteps == 0
+            && std::chrono::steady_clock::now() > deadline) {
+                data.status = RegexData::DEADLINE_EXCEEDED;
+            }
+            if(data.status != RegexData::OK) {
+                data.startPos = callStart;
+                data.groups.assign(data.groups.size(), RegexData::Group{ -1, -1 });
+                data.rewindTo(callStart);
+                return false;
+            }
+            STAT_COUNT(data, steps);
+
+            const BitProgram::State& s = bits.states[state];
+            uint64_t next = 0;
+            int ulen = 0;
+            if(pos < strLen) {
+                const unsigned char lead = str[pos];
+                ulen = std::min(unitLength(lead), strLen - pos);
+                STAT_COUNT(data, unitsFetched);
+                const int cls = ulen == 1 ? bits.byteClass[lead] : bits.classOf(str + pos, ulen);
+                next = s.follow & bits.classMasks[cls];
+            } else if(s.follow != 0) {
+                data.markHitEnd(from);
+            }
+            const int followCount = captures ? popCount(s.follow) : 0;
+            touched |= s.touched;
+
+            if(s.final) {
+                if(!(next & s.beforeEnd)) {
+                    matchEnd = pos;
+                    if(captures) { applyOps(bits, s.ops + 3 * followCount, data.groups, pos); }
+                    break;
+                }
+                fallback = pos;
+                fallbackState = state;
+                fallbackRank = popCount(s.follow & (next - 1));
+                if(captures) {
+                    data.onePassGroups = data.groups;
+                    touched = 0;
+                }
+            }
+            if(next == 0) {
+                if(fallback != -1 && captures) {
+                    const BitProgram::State& f = bits.states[fallbackState];
+                    const int n = popCount(f.follow);
+                    data.groups.swap(data.onePassGroups);
+                    applyOps(bits, f.ops + n + fallbackRank, data.groups, fallback);
+                    for(; touched != 0; touched &= touched - 1) { setField(data.groups, lowestBit(touched), -1); }
+                    applyOps(bits, f.ops + 2 * n + fallbackRank, data.groups, fallback);
+                }
+                matchEnd = fallback;
+                break;
+            }
+
+            if(captures) { applyOps(bits, s.ops + popCount(s.follow & (next - 1)), data.groups, pos); }
+            state = lowestBit(next);
+            pos += ulen;
+        }
+
+        if(matchEnd != -1) { break; }
+        STAT_COUNT(data, failedStarts);
+        if(from >= strLen) {
+            data.startPos = strLen;
+            data.groups.assign(data.groups.size(), RegexData::Group{ -1, -1 });
+            data.rewindTo(strLen);
+            data.at = RegexData::LINE_AT_PAST_EOF;
+            return false;
+        }
+        from = std::min(from + unitLength(str[from]), strLen);
+    }
+    data.startPos = from;
+    data.rewindTo(matchEnd);
+    data.finishMatch(start, end);
+    STAT_TOKEN(data);
+    return true;
+}
+
+} // namespace dlexer
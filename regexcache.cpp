@@ -0,0 +1,86 @@
+#include <dlexer/regexcache.hpp>
+#include <dlexer/regex.hpp>
+#include <cstring>
+
+namespace dlexer {
+
+RegexCache& RegexCache::global() {
+    static RegexCache cache;
+    return cache;
+}
+
+RegexCache::RegexCache(size_t capacity): capacity(capacity) {}
+
+void RegexCache::setCapacity(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    capacity = bytes;
+    evictUntilFits(bytes);
+}
+
+size_t RegexCache::getCapacity() const { return capacity; }
+
+std::string RegexCache::makeKey(const std::string& pat, unsigned flags) {
+    std::string key(sizeof(flags), '\0');
+    std::memcpy(&key[0], &flags, sizeof(flags));
+    key += pat;
+    return key;
+}
+
+std::shared_ptr<const char> RegexCache::find(const std::string& pat, unsigned flags) {
+    if(capacity == 0) { return nullptr; }
+
+    const std::string key = makeKey(pat, flags);
+    std::lock_guard<std::mutex> lock(mutex);
+
+    const auto found = index.find(key);
+    if(found == index.end()) {
+        stats.misses++;
+        return nullptr;
+    }
+
+    stats.hits++;
+    lru.splice(lru.begin(), lru, found->second);
+    return found->second->image;
+}
+
+void RegexCache::insert(const std::string& pat, unsigned flags, std::shared_ptr<const char> image) {
+    if(capacity == 0) { return; }
+
+    std::string key = makeKey(pat, flags);
+    const auto& header = *reinterpret_cast<const dtl::ProgHeader*>(image.get());
+    const size_t bytes = header.size + key.size();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if(bytes > capacity || index.count(key) != 0) { return; }
+
+    evictUntilFits(capacity - bytes);
+    lru.push_front({ key, std::move(image), bytes });
+    index.emplace(std::move(key), lru.begin());
+    stats.entries++;
+    stats.bytes += bytes;
+}
+
+void RegexCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    evictUntilFits(0);
+    stats = {};
+}
+
+RegexCache::Stats RegexCache::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+// mutex must be held
+void RegexCache::evictUntilFits(size_t limit) {
+    while(stats.bytes > limit) {
+        const Entry& last = lru.back();
+        stats.bytes -= last.bytes;
+        stats.entries--;
+        stats.evictions++;
+        index.erase(last.key);
+        lru.pop_back();
+    }
+}
+
+} // namespace dlexer
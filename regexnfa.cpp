@@ -0,0 +1,229 @@
+#include <dlexer/regex.hpp>
+#include <dlexer/common.hpp>
+#include "regexstats.hpp"
+#include <algorithm>
+
+namespace dlexer {
+
+using namespace dtl;
+
+using LineAt = decltype(RegexData::at);
+
+// the state RegexData::updateAt() gives at pos
+static LineAt lineAt(const RegexData& data, int pos) {
+    if(pos == static_cast<int>(data.strLen)) { return RegexData::LINE_AT_EOF; }
+    if(pos == 0) { return RegexData::LINE_AT_START; }
+    if(data.str[pos - 1] == '\n' || data.str[pos] == '\n') { return RegexData::LINE_AT_END; }
+    return RegexData::LINE_AT_MID;
+}
+
+// Pike VM over the program. Threads are kept in the order the backtracker
+// would try their paths, and a matched thread cuts all threads after it,
+// so the match is the same one the backtracker finds first.
+struct NfaRunner {
+    const Program& prog;
+    RegexData& data;
+    NfaState& st;
+    const int stride;
+    // position the closure is computed at
+    int pos = 0;
+    LineAt at = RegexData::LINE_AT_START;
+
+    NfaRunner(const Program& prog, RegexData& data)
+        : prog(prog)
+        , data(data)
+        , st(data.nfa)
+        , stride(1 + 2 * static_cast<int>(data.groups.size()))
+    {
+        if(st.mark.size() < prog.header->nodeCount) {
+            st.mark.assign(prog.header->nodeCount, 0);
+            st.gen = 0;
+        }
+    }
+
+    void nextGeneration() {
+        if(++st.gen == 0) {
+            std::fill(st.mark.begin(), st.mark.end(), 0);
+            st.gen = 1;
+        }
+    }
+
+    // adds node with caps at st.scratch[caps] and follows epsilon nodes
+    void add(NfaList& list, uint32_t id, size_t caps) {
+        if(st.mark[id] == st.gen) { return; }
+        st.mark[id] = st.gen;
+
+        const ProgNode& n = prog.nodes[id];
+        switch(n.kind) {
+        case PROG_UNIT: case PROG_RANGE: case PROG_END: {
+            list.nodes.push_back(id);
+            list.caps.insert(list.caps.end(), st.scratch.begin() + caps, st.scratch.begin() + caps + stride);
+            return;
+        }
+        case PROG_OR: {
+            if(n.flags & PROG_NEGATIVE) {
+                list.nodes.push_back(id);
+                list.caps.insert(list.caps.end(), st.scratch.begin() + caps, st.scratch.begin() + caps + stride);
+                return;
+            }
+        } break;
+        case PROG_GROUP: {
+            if(!(n.flags & PROG_CAPTURE) || stride == 1) { break; }
+
+            const size_t copy = st.scratch.size();
+            st.scratch.insert(st.scratch.end(), st.scratch.begin() + caps, st.scratch.begin() + caps + stride);
+            st.scratch[copy + 1 + 2 * n.groupId + ((n.flags & PROG_IS_END) ? 1 : 0)] = pos;
+            addChildren(list, n, 0, copy);
+            st.scratch.resize(copy);
+            return;
+        }
+        case PROG_AT_START: {
+            if(at == RegexData::LINE_AT_EOF) { data.markHitEnd(st.scratch[caps]); }
+            if(at == RegexData::LINE_AT_MID) { return; }
+        } break;
+        case PROG_AT_END: {
+            if(at == RegexData::LINE_AT_EOF) { data.markHitEnd(st.scratch[caps]); }
+            if(at != RegexData::LINE_AT_EOF && at != RegexData::LINE_AT_END) { return; }
+        } break;
+        case PROG_START: case PROG_FAIL: return;
+        default: break;
+        }
+        addChildren(list, n, 0, caps);
+    }
+
+    void addChildren(NfaList& list, const ProgNode& n, uint32_t first, size_t caps) {
+        for(uint32_t i = first; i < n.childCount; ++i) {
+            add(list, prog.children[n.firstChild + i], caps);
+        }
+    }
+
+    void seed(NfaList& list) {
+        st.scratch.assign(stride, -1);
+        st.scratch[0] = pos;
+        addChildren(list, prog.nodes[0], 0, 0);
+    }
+
+    void moveTo(int p, LineAt at) {
+        this->pos = p;
+        this->at = at;
+    }
+    void moveTo(int p) { moveTo(p, lineAt(data, p)); }
+};
+
+bool RegexLexer::getTokenNfa(const char** start, const char** end, RegexData& data) const {
+    static const uint64_t DeadlineCheckSteps = 1024;
+    const uint64_t stepLimit = data.stepBudget != 0 ? data.stepBudget : UINT64_MAX;
+    const bool hasDeadline = data.timeBudget.count() > 0;
+    const auto deadline = hasDeadline
+        ? std::chrono::steady_clock::now() + data.timeBudget
+        : std::chrono::steady_clock::time_point{};
+    uint64_t steps = 0;
+
+    NfaRunner r(prog, data);
+    NfaList* clist = &data.nfa.lists[0];
+    NfaList* nlist = &data.nfa.lists[1];
+    clist->nodes.clear();
+    clist->caps.clear();
+
+    const int strLen = static_cast<int>(data.strLen);
+    const int callStart = data.pos;
+    int p = data.pos;
+    bool matched = false;
+    int matchEnd = -1;
+    // positions seeded, all but the match start are failed starts
+    uint64_t starts = 0;
+    std::vector<int>& caps = data.nfa.caps;
+
+    r.nextGeneration();
+    while(true) {
+        if(!matched) {
+            if(clist->nodes.empty() && !prog.header->anyFirstByte) {
+                while(p < strLen && !prog.canStartWith(data.str[p])) { p += unitLength(data.str[p]); }
+                p = std::min(p, strLen);
+            }
+            // data.at is kept where the call starts, as getToken() does
+            if(p == callStart) { r.moveTo(p, data.at); }
+            else { r.moveTo(p); }
+            r.seed(*clist);
+            starts++;
+        }
+        if(clist->nodes.empty()) {
+            if(matched || p >= strLen) { break; }
+            p = std::min(p + unitLength(data.str[p]), strLen);
+            r.nextGeneration();
+            continue;
+        }
+
+        data.ulen = 0;
+        if(p < strLen) {
+            data.ulen = std::min(extractUnitStr(data.unit, data.str + p), strLen - p);
+            STAT_COUNT(data, unitsFetched);
+        }
+
+        r.nextGeneration();
+        r.moveTo(p + data.ulen);
+        nlist->nodes.clear();
+        nlist->caps.clear();
+        for(size_t i = 0; i < clist->nodes.size(); ++i) {
+            if(++steps > stepLimit) { data.status = RegexData::STEP_BUDGET_EXCEEDED; }
+            if(hasDeadline && steps % DeadlineCheckSteps == 0
+            && std::chrono::steady_clock::now() > deadline) {
+                data.status = RegexData::DEADLINE_EXCEEDED;
+            }
+            if(data.status != RegexData::OK) {
+                data.startPos = callStart;
+                data.rewindTo(callStart);
+                return false;
+            }
+
+            STAT_COUNT(data, steps);
+            const uint32_t id = clist->nodes[i];
+            const ProgNode& n = prog.nodes[id];
+            STAT_NODE(data, id, steps);
+            const auto threadCaps = clist->caps.begin() + i * r.stride;
+            if(n.kind == PROG_END) {
+                matched = true;
+                matchEnd = p;
+                caps.assign(threadCaps, threadCaps + r.stride);
+                break;
+            }
+            // threads wanting a unit at the end, caps[0] is where they start
+            if(data.ulen == 0) {
+                data.markHitEnd(threadCaps[0]);
+                continue;
+            }
+
+            const int next = satisfies(prog, n, data);
+            if(next == -1) {
+                STAT_NODE(data, id, fails);
+                continue;
+            }
+
+            data.nfa.scratch.assign(threadCaps, threadCaps + r.stride);
+            r.addChildren(*nlist, n, next, 0);
+        }
+
+        std::swap(clist, nlist);
+        if(data.ulen == 0) { break; }
+        p += data.ulen;
+    }
+
+    STAT_ADD(data, failedStarts, matched ? starts - 1 : starts);
+    if(!matched) {
+        data.startPos = strLen;
+        data.rewindTo(strLen);
+        data.at = RegexData::LINE_AT_PAST_EOF;
+        return false;
+    }
+
+    for(size_t g = 0; g < data.groups.size(); ++g) {
+        data.groups[g] = RegexData::Group{ caps[1 + 2 * g], caps[2 + 2 * g] };
+    }
+    data.startPos = caps[0];
+    data.rewindTo(matchEnd);
+    data.finishMatch(start, end);
+    STAT_TOKEN(data);
+    return true;
+}
+
+} // namespace dlexer
@@ -0,0 +1,143 @@
+#include <dlexer/regex.hpp>
+#include <dlexer/common.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+
+namespace dlexer {
+
+using namespace dtl;
+
+// the same names as NameVisitor gives to the graph nodes
+static const char* kindName(uint8_t kind) {
+    static const char* names[] = {
+        "UnitNode", "StartNode", "GroupNode", "OrNode", "RepeatNode",
+        "EndNode", "AtStartNode", "AtEndNode", "RangeNode", "FailNode",
+    };
+    return kind <= PROG_FAIL ? names[kind] : "?";
+}
+
+static std::string describe(const ProgNode& n) {
+    std::string res = kindName(n.kind);
+    switch(n.kind) {
+    case PROG_UNIT: {
+        res += " '";
+        res.append(reinterpret_cast<const char*>(n.a), n.ulen);
+        res += '\'';
+    } break;
+    case PROG_RANGE: {
+        res += " '";
+        res.append(reinterpret_cast<const char*>(n.a), n.ulen);
+        res += "'-'";
+        res.append(reinterpret_cast<const char*>(n.b), n.ulen);
+        res += '\'';
+    } break;
+    case PROG_GROUP: {
+        res += n.flags & PROG_IS_END ? " end" : " start";
+        if(n.flags & PROG_CAPTURE) { res += " #" + std::to_string(n.groupId); }
+    } break;
+    case PROG_OR: if(n.flags & PROG_NEGATIVE) { res += " negative"; } break;
+    case PROG_REPEAT: {
+        static const char* modes[] = { " *", " ?", " +" };
+        res += n.mode < 3 ? modes[n.mode] : " ?";
+        if(n.flags & PROG_LAZY) { res += '?'; }
+    } break;
+    default: break;
+    }
+    return res;
+}
+
+// number of units before byte offset, so that caret is under the symbol
+// in a terminal showing UTF-8
+static int columnOf(const std::string& pattern, int pos) {
+    int col = 0;
+    for(int i = 0; i < pos; i += unitLength(pattern[i])) { col++; }
+    return col;
+}
+
+std::string RegexLexer::profileReport(const RegexProfile& profile) const {
+    std::vector<uint32_t> order;
+    uint64_t totalSteps = 0;
+    for(uint32_t i = 0; i < profile.nodes.size() && i < prog.header->nodeCount; ++i) {
+        if(profile.nodes[i].steps == 0) { continue; }
+        order.push_back(i);
+        totalSteps += profile.nodes[i].steps;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t l, uint32_t r) {
+        return profile.nodes[l].steps > profile.nodes[r].steps;
+    });
+
+    std::ostringstream out;
+    out << "pattern: " << pattern << '\n';
+    out << "steps: " << totalSteps << '\n';
+
+    static const std::string indent(sizeof("pattern: ") - 1, ' ');
+    for(const uint32_t id: order) {
+        const ProgNode& n = prog.nodes[id];
+        const RegexProfile::NodeCounters& c = profile.nodes[id];
+
+        char share[16];
+        std::snprintf(share, sizeof(share), "%5.1f%%", 100.0 * c.steps / totalSteps);
+
+        out << indent;
+        if(n.patternPos >= 0) {
+            out << std::string(columnOf(pattern, n.patternPos), ' ') << '^';
+        } else {
+            out << '-';
+        }
+        out << ' ' << share << " #" << id << ' ' << describe(n)
+            << ": steps " << c.steps
+            << ", fails " << c.fails
+            << ", backtracks " << c.backtracks << '\n';
+    }
+    return out.str();
+}
+
+static std::string escapeDot(const std::string& s) {
+    std::string res;
+    for(const char c: s) {
+        if(c == '"' || c == '\\') { res += '\\'; }
+        res += c;
+    }
+    return res;
+}
+
+void RegexLexer::writeProfileDot(std::ostream& out, const RegexProfile& profile) const {
+    const uint32_t nodeCount = prog.header->nodeCount;
+    auto countersOf = [&](uint32_t id) {
+        return id < profile.nodes.size() ? profile.nodes[id] : RegexProfile::NodeCounters{};
+    };
+
+    uint64_t maxSteps = 1;
+    for(uint32_t i = 0; i < nodeCount; ++i) {
+        maxSteps = std::max(maxSteps, countersOf(i).steps);
+    }
+
+    out << "digraph regex {\n";
+    out << "    label=\"" << escapeDot(pattern) << "\";\n";
+    out << "    node [shape=box, style=filled];\n";
+    for(uint32_t i = 0; i < nodeCount; ++i) {
+        const ProgNode& n = prog.nodes[i];
+        const RegexProfile::NodeCounters c = countersOf(i);
+
+        // white for cold nodes to red for the hottest one
+        const int heat = static_cast<int>(255 - 255 * c.steps / maxSteps);
+        char color[8];
+        std::snprintf(color, sizeof(color), "#ff%02x%02x", heat, heat);
+
+        out << "    n" << i << " [label=\"#" << i << ' ' << escapeDot(describe(n));
+        if(n.patternPos >= 0) { out << " @" << n.patternPos; }
+        out << "\\nsteps " << c.steps
+            << "\\nfails " << c.fails
+            << "\\nbacktracks " << c.backtracks
+            << "\", fillcolor=\"" << color << "\"];\n";
+
+        for(uint32_t ch = 0; ch < n.childCount; ++ch) {
+            out << "    n" << i << " -> n" << prog.children[n.firstChild + ch]
+                << " [label=\"" << ch << "\"];\n";
+        }
+    }
+    out << "}\n";
+}
+
+} // namespace dlexer
@@ -0,0 +1,420 @@
+#include <dlexer/regex.hpp>
+#include <dlexer/common.hpp>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <unordered_map>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define DLEXER_HAS_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace dlexer {
+
+namespace dtl {
+
+struct ProgBuildVisitor: INodeVisitor {
+    ProgNode& out;
+
+    ProgBuildVisitor(ProgNode& out): out(out) {}
+
+    void visit(UnitNode& n) override {
+        out.kind = PROG_UNIT;
+        out.ulen = n.ulen;
+        std::memcpy(out.a, n.unit, sizeof(out.a));
+    }
+    void visit(StartNode& _) override { out.kind = PROG_START; }
+    void visit(GroupNode& n) override {
+        out.kind = PROG_GROUP;
+        out.groupId = n.groupId;
+        if(n.isEnd()) { out.flags |= PROG_IS_END; }
+        if(n.capture) { out.flags |= PROG_CAPTURE; }
+    }
+    void visit(OrNode& n) override {
+        out.kind = PROG_OR;
+        if(n.isNegative) { out.flags |= PROG_NEGATIVE; }
+    }
+    void visit(RepeatNode& n) override {
+        out.kind = PROG_REPEAT;
+        out.mode = n.mode;
+        if(n.isLazy) { out.flags |= PROG_LAZY; }
+    }
+    void visit(EndNode& _) override { out.kind = PROG_END; }
+    void visit(AtStartNode& _) override { out.kind = PROG_AT_START; }
+    void visit(AtEndNode& _) override { out.kind = PROG_AT_END; }
+    void visit(RangeNode& n) override {
+        assert(n.startlen == n.endlen);
+        out.kind = PROG_RANGE;
+        out.ulen = n.startlen;
+        std::memcpy(out.a, n.start, sizeof(out.a));
+        std::memcpy(out.b, n.end, sizeof(out.b));
+    }
+    void visit(FailNode& _) override { out.kind = PROG_FAIL; }
+};
+
+static size_t alignUp(size_t off) { return (off + 7) & ~static_cast<size_t>(7); }
+
+static void addFirstBytes(const std::vector<ProgNode>& nodes, const std::vector<uint32_t>& children, int id, std::vector<bool>& visited, ProgHeader& h) {
+    if(visited[id] || h.anyFirstByte) { return; }
+    visited[id] = true;
+
+    const ProgNode& n = nodes[id];
+    switch(n.kind) {
+    case PROG_UNIT: h.firstBytes[n.a[0] >> 3] |= 1 << (n.a[0] & 7); return;
+    case PROG_RANGE: {
+        for(int b = n.a[0]; b <= n.b[0]; ++b) {
+            h.firstBytes[b >> 3] |= 1 << (b & 7);
+        }
+        return;
+    }
+    case PROG_END: h.anyFirstByte = 1; return;
+    case PROG_FAIL: return;
+    case PROG_OR: {
+        if(n.flags & PROG_NEGATIVE) { h.anyFirstByte = 1; return; }
+    } break;
+    default: break;
+    }
+
+    for(uint32_t i = 0; i < n.childCount; ++i) {
+        addFirstBytes(nodes, children, children[n.firstChild + i], visited, h);
+    }
+}
+
+// vectors may have no data to copy from
+static void writeSection(char* to, const void* from, size_t bytes) {
+    if(bytes != 0) { std::memcpy(to, from, bytes); }
+}
+
+static uint64_t toImageBound(size_t bound) {
+    return bound == RegexAnalysis::Unbounded ? UINT64_MAX : bound;
+}
+
+static size_t fromImageBound(uint64_t bound) {
+    return bound == UINT64_MAX ? RegexAnalysis::Unbounded : static_cast<size_t>(bound);
+}
+
+static bool inImage(uint32_t offset, uint64_t bytes, size_t align, size_t size) {
+    return offset % align == 0 && uint64_t(offset) + bytes <= size;
+}
+
+static int popCount(uint64_t mask) {
+    int res = 0;
+    for(; mask != 0; mask &= mask - 1) { res++; }
+    return res;
+}
+
+// returns the error, or nullptr if getTokenBits() can't read outside of
+// the tables or the groups
+static const char* checkBits(const char* img, size_t size, const ProgHeader& h) {
+    if(h.engine != RegexAnalysis::BITPARALLEL && h.engine != RegexAnalysis::ONEPASS) { return nullptr; }
+    if((h.engine == RegexAnalysis::ONEPASS) != (h.groupCount != 0)) { return "invalid engine"; }
+    if(h.bitStateCount == 0 || h.bitStateCount > 65 || h.classCount == 0 || h.opBoundCount == 0 || h.groupCount > 32) {
+        return "invalid bit program";
+    }
+    if(!inImage(h.bitStatesOffset, uint64_t(h.bitStateCount) * sizeof(BitProgram::State), alignof(BitProgram::State), size)
+    || !inImage(h.byteClassOffset, 256 * sizeof(uint16_t), alignof(uint16_t), size)
+    || !inImage(h.classStartsOffset, uint64_t(h.classCount) * sizeof(uint64_t), alignof(uint64_t), size)
+    || !inImage(h.classMasksOffset, uint64_t(h.classCount) * sizeof(uint64_t), alignof(uint64_t), size)
+    || !inImage(h.opBoundsOffset, uint64_t(h.opBoundCount) * sizeof(uint32_t), alignof(uint32_t), size)
+    || !inImage(h.groupOpsOffset, uint64_t(h.groupOpCount) * sizeof(BitProgram::GroupOp), alignof(BitProgram::GroupOp), size)) {
+        return "bit program tables are out of bounds";
+    }
+
+    const BitProgram::State* states = reinterpret_cast<const BitProgram::State*>(img + h.bitStatesOffset);
+    const uint16_t* byteClass = reinterpret_cast<const uint16_t*>(img + h.byteClassOffset);
+    const uint64_t* classStarts = reinterpret_cast<const uint64_t*>(img + h.classStartsOffset);
+    const uint32_t* opBounds = reinterpret_cast<const uint32_t*>(img + h.opBoundsOffset);
+    const BitProgram::GroupOp* groupOps = reinterpret_cast<const BitProgram::GroupOp*>(img + h.groupOpsOffset);
+
+    // follow masks are of consuming states, which come before the start state
+    const uint32_t consuming = h.bitStateCount - 1;
+    const uint64_t stateMask = consuming == 64 ? UINT64_MAX : (uint64_t(1) << consuming) - 1;
+    const uint64_t fieldMask = h.groupCount == 32 ? UINT64_MAX : (uint64_t(1) << (2 * h.groupCount)) - 1;
+    for(uint32_t i = 0; i < h.bitStateCount; ++i) {
+        const BitProgram::State& s = states[i];
+        if((s.follow & ~stateMask) || (s.beforeEnd & ~stateMask) || (s.touched & ~fieldMask)) {
+            return "invalid bit state";
+        }
+        if(h.groupCount != 0 && uint64_t(s.ops) + 3 * popCount(s.follow) + 1 >= h.opBoundCount) {
+            return "invalid bit state ops";
+        }
+    }
+    if(classStarts[0] != 0) { return "invalid unit classes"; }
+    for(uint32_t i = 1; i < h.classCount; ++i) {
+        if(classStarts[i] <= classStarts[i - 1]) { return "invalid unit classes"; }
+    }
+    for(int c = 0; c < 256; ++c) {
+        if(byteClass[c] >= h.classCount) { return "invalid unit classes"; }
+    }
+    for(uint32_t i = 0; i < h.opBoundCount; ++i) {
+        if(opBounds[i] > h.groupOpCount || (i != 0 && opBounds[i] < opBounds[i - 1])) { return "invalid group ops"; }
+    }
+    for(uint32_t i = 0; i < h.groupOpCount; ++i) {
+        if(groupOps[i].field >= 2 * h.groupCount) { return "invalid group ops"; }
+    }
+    return nullptr;
+}
+
+} // namespace dtl
+
+using namespace dtl;
+
+void RegexLexer::compileProgram() {
+    std::unordered_map<const Node*, uint32_t> index;
+    for(uint32_t i = 0; i < nodes.size(); ++i) { index[nodes[i].get()] = i; }
+
+    std::vector<ProgNode> progNodes(nodes.size(), ProgNode{});
+    std::vector<uint32_t> children;
+    for(size_t i = 0; i < nodes.size(); ++i) {
+        Node& n = *nodes[i];
+        ProgNode& out = progNodes[i];
+
+        out.groupId = -1;
+        out.patternPos = n.patternPos;
+        ProgBuildVisitor v(out);
+        n.acceptVisitor(v);
+        if(n.needsUnit) { out.flags |= PROG_NEEDS_UNIT; }
+
+        out.firstChild = children.size();
+        out.childCount = n.children.size();
+        for(const Node* child: n.children) {
+            children.push_back(index.at(child));
+        }
+    }
+
+    ProgHeader h{};
+    std::memcpy(h.magic, ProgMagic, sizeof(h.magic));
+    h.version = ProgVersion;
+    h.endianTag = ProgEndianTag;
+    h.groupCount = freeGroupId;
+    h.flags = flags;
+
+    std::vector<bool> visited(progNodes.size(), false);
+    for(uint32_t i = 0; i < progNodes[0].childCount; ++i) {
+        addFirstBytes(progNodes, children, children[progNodes[0].firstChild + i], visited, h);
+    }
+
+    h.patternOffset = alignUp(sizeof(ProgHeader));
+    h.patternLength = pattern.size();
+    h.nodesOffset = alignUp(h.patternOffset + h.patternLength + 1);
+    h.nodeCount = progNodes.size();
+    h.childrenOffset = alignUp(h.nodesOffset + h.nodeCount * sizeof(ProgNode));
+    h.childCount = children.size();
+
+    Program view;
+    view.header = &h;
+    view.nodes = progNodes.data();
+    view.children = children.data();
+    RegexAnalysis a = analyzeProgram(view);
+    h.features = a.features;
+    h.ambiguousPos = a.ambiguousPos;
+    h.stackDepth = stackDepth(view);
+    lengthBounds(view, a);
+    h.maxTokenLength = toImageBound(a.maxTokenLength);
+    h.maxLookahead = toImageBound(a.maxLookahead);
+
+    BitTables bits;
+    // a pattern too big to analyze may be exponential as well
+    const bool risky = (a.has(RegexAnalysis::EXPONENTIAL) || a.has(RegexAnalysis::UNANALYZED))
+        && !(flags & (MEMOIZE | BACKTRACK));
+    if((flags & NFA) || risky) {
+        h.engine = RegexAnalysis::NFA;
+    } else if(!(flags & (MEMOIZE | BACKTRACK)) && bits.build(view)) {
+        h.engine = h.groupCount != 0 ? RegexAnalysis::ONEPASS : RegexAnalysis::BITPARALLEL;
+    } else {
+        h.engine = RegexAnalysis::BACKTRACK;
+    }
+
+    size_t end = h.childrenOffset + h.childCount * sizeof(uint32_t);
+    if(h.engine == RegexAnalysis::ONEPASS || h.engine == RegexAnalysis::BITPARALLEL) {
+        h.bitStatesOffset = alignUp(end);
+        h.bitStateCount = bits.states.size();
+        h.byteClassOffset = alignUp(h.bitStatesOffset + h.bitStateCount * sizeof(BitProgram::State));
+        h.classStartsOffset = alignUp(h.byteClassOffset + sizeof(bits.byteClass));
+        h.classCount = bits.classStarts.size();
+        h.classMasksOffset = alignUp(h.classStartsOffset + h.classCount * sizeof(uint64_t));
+        h.opBoundsOffset = alignUp(h.classMasksOffset + h.classCount * sizeof(uint64_t));
+        h.opBoundCount = bits.opBounds.size();
+        h.groupOpsOffset = alignUp(h.opBoundsOffset + h.opBoundCount * sizeof(uint32_t));
+        h.groupOpCount = bits.groupOps.size();
+        end = h.groupOpsOffset + h.groupOpCount * sizeof(BitProgram::GroupOp);
+    }
+    h.size = alignUp(end);
+
+    std::shared_ptr<char> img(new char[h.size](), std::default_delete<char[]>());
+    std::memcpy(img.get(), &h, sizeof(h));
+    writeSection(img.get() + h.patternOffset, pattern.data(), pattern.size());
+    writeSection(img.get() + h.nodesOffset, progNodes.data(), h.nodeCount * sizeof(ProgNode));
+    writeSection(img.get() + h.childrenOffset, children.data(), h.childCount * sizeof(uint32_t));
+    if(h.bitStateCount != 0) {
+        writeSection(img.get() + h.bitStatesOffset, bits.states.data(), h.bitStateCount * sizeof(BitProgram::State));
+        writeSection(img.get() + h.byteClassOffset, bits.byteClass, sizeof(bits.byteClass));
+        writeSection(img.get() + h.classStartsOffset, bits.classStarts.data(), h.classCount * sizeof(uint64_t));
+        writeSection(img.get() + h.classMasksOffset, bits.classMasks.data(), h.classCount * sizeof(uint64_t));
+        writeSection(img.get() + h.opBoundsOffset, bits.opBounds.data(), h.opBoundCount * sizeof(uint32_t));
+        writeSection(img.get() + h.groupOpsOffset, bits.groupOps.data(), h.groupOpCount * sizeof(BitProgram::GroupOp));
+    }
+
+    const bool ok = useImage(img, h.size, nullptr);
+    assert(ok && "compiled image must be valid");
+}
+
+static bool fail(std::string* error, const char* msg) {
+    if(error != nullptr) { *error = msg; }
+    return false;
+}
+
+bool RegexLexer::useImage(std::shared_ptr<const char> img, size_t size, std::string* error) {
+    if(size < sizeof(ProgHeader)) { return fail(error, "image is too small"); }
+
+    const ProgHeader& h = *reinterpret_cast<const ProgHeader*>(img.get());
+    if(std::memcmp(h.magic, ProgMagic, sizeof(h.magic)) != 0) { return fail(error, "not a dlexer regex image"); }
+    if(h.endianTag != ProgEndianTag) { return fail(error, "image has different byte order"); }
+    if(h.version != ProgVersion) { return fail(error, "unsupported image version"); }
+    if(h.size != size) { return fail(error, "image size mismatch"); }
+
+    const uint64_t nodesEnd = uint64_t(h.nodesOffset) + uint64_t(h.nodeCount) * sizeof(ProgNode);
+    const uint64_t childrenEnd = uint64_t(h.childrenOffset) + uint64_t(h.childCount) * sizeof(uint32_t);
+    if(uint64_t(h.patternOffset) + h.patternLength > size || nodesEnd > size || childrenEnd > size
+    || h.nodesOffset % alignof(ProgNode) != 0 || h.childrenOffset % alignof(uint32_t) != 0) {
+        return fail(error, "image sections are out of bounds");
+    }
+    if(h.nodeCount == 0) { return fail(error, "image has no start node"); }
+
+    const ProgNode* pnodes = reinterpret_cast<const ProgNode*>(img.get() + h.nodesOffset);
+    const uint32_t* pchildren = reinterpret_cast<const uint32_t*>(img.get() + h.childrenOffset);
+    if(pnodes[0].kind != PROG_START) { return fail(error, "first node isn't start node"); }
+
+    // bounds checks only, so that a corrupted image can't make getToken()
+    // read outside of it
+    for(uint32_t i = 0; i < h.nodeCount; ++i) {
+        const ProgNode& n = pnodes[i];
+        if(n.kind > PROG_FAIL || n.ulen > 4
+        || n.patternPos < -1 || n.patternPos >= static_cast<int64_t>(h.patternLength)) {
+            return fail(error, "invalid node");
+        }
+        if(uint64_t(n.firstChild) + n.childCount > h.childCount) { return fail(error, "invalid node children"); }
+        if(n.childCount == 0 && n.kind != PROG_END && n.kind != PROG_FAIL) {
+            return fail(error, "only end and fail nodes may have no children");
+        }
+        if((n.flags & PROG_CAPTURE) && (n.groupId < 0 || n.groupId >= static_cast<int32_t>(h.groupCount))) {
+            return fail(error, "invalid group id");
+        }
+    }
+    for(uint32_t i = 0; i < h.childCount; ++i) {
+        if(pchildren[i] >= h.nodeCount) { return fail(error, "invalid child index"); }
+    }
+    // the stack reserved for a token is at most a path through all nodes
+    if(h.engine > RegexAnalysis::ONEPASS || h.stackDepth > h.nodeCount) { return fail(error, "invalid analysis"); }
+    if(const char* bitsError = checkBits(img.get(), size, h)) { return fail(error, bitsError); }
+
+    attachImage(std::move(img));
+    return true;
+}
+
+void RegexLexer::attachImage(std::shared_ptr<const char> img) {
+    const ProgHeader& h = *reinterpret_cast<const ProgHeader*>(img.get());
+
+    this->image = std::move(img);
+    this->prog.header = &h;
+    this->prog.nodes = reinterpret_cast<const ProgNode*>(this->image.get() + h.nodesOffset);
+    this->prog.children = reinterpret_cast<const uint32_t*>(this->image.get() + h.childrenOffset);
+    this->pattern.assign(this->image.get() + h.patternOffset, h.patternLength);
+    this->freeGroupId = h.groupCount;
+    this->flags = h.flags;
+
+    this->analysis.features = h.features;
+    this->analysis.ambiguousPos = h.ambiguousPos;
+    this->analysis.stackDepth = h.stackDepth;
+    this->analysis.maxTokenLength = fromImageBound(h.maxTokenLength);
+    this->analysis.maxLookahead = fromImageBound(h.maxLookahead);
+    this->analysis.engine = static_cast<RegexAnalysis::Engine>(h.engine);
+
+    this->bits = BitProgram{};
+    if(analysis.engine == RegexAnalysis::BITPARALLEL || analysis.engine == RegexAnalysis::ONEPASS) {
+        const char* base = this->image.get();
+        bits.states = reinterpret_cast<const BitProgram::State*>(base + h.bitStatesOffset);
+        bits.stateCount = h.bitStateCount;
+        bits.byteClass = reinterpret_cast<const uint16_t*>(base + h.byteClassOffset);
+        bits.classStarts = reinterpret_cast<const uint64_t*>(base + h.classStartsOffset);
+        bits.classMasks = reinterpret_cast<const uint64_t*>(base + h.classMasksOffset);
+        bits.classCount = h.classCount;
+        bits.opBounds = reinterpret_cast<const uint32_t*>(base + h.opBoundsOffset);
+        bits.groupOps = reinterpret_cast<const BitProgram::GroupOp*>(base + h.groupOpsOffset);
+    }
+}
+
+const std::string& RegexLexer::getPattern() const { return pattern; }
+
+int RegexLexer::getGroupCount() const { return freeGroupId; }
+
+unsigned RegexLexer::getFlags() const { return flags; }
+
+const RegexAnalysis& RegexLexer::getAnalysis() const { return analysis; }
+
+std::string RegexLexer::getImage() const {
+    return std::string(image.get(), prog.header->size);
+}
+
+bool RegexLexer::writeImage(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary);
+    out.write(image.get(), prog.header->size);
+    return out.good();
+}
+
+std::unique_ptr<RegexLexer> RegexLexer::fromImage(std::shared_ptr<const char> img, size_t size, std::string* error) {
+    std::unique_ptr<RegexLexer> l(new RegexLexer());
+    if(!l->useImage(std::move(img), size, error)) { return nullptr; }
+    return l;
+}
+
+std::unique_ptr<RegexLexer> RegexLexer::fromImageFile(const std::string& path, std::string* error) {
+#ifdef DLEXER_HAS_MMAP
+    const int fd = open(path.c_str(), O_RDONLY);
+    if(fd == -1) {
+        fail(error, "can't open image file");
+        return nullptr;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        fail(error, "can't stat image file");
+        return nullptr;
+    }
+
+    const size_t size = st.st_size;
+    void* mem = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mem == MAP_FAILED) {
+        fail(error, "can't map image file");
+        return nullptr;
+    }
+
+    std::shared_ptr<const char> img(static_cast<const char*>(mem), [size](const char* p) {
+        munmap(const_cast<char*>(p), size);
+    });
+    return fromImage(std::move(img), size, error);
+#else
+    std::ifstream in(path, std::ios::binary);
+    const std::string bytes(
+        (std::istreambuf_iterator<char>(in)),
+        (std::istreambuf_iterator<char>())
+    );
+    if(bytes.empty()) {
+        fail(error, "can't read image file");
+        return nullptr;
+    }
+
+    std::shared_ptr<char> img(new char[bytes.size()], std::default_delete<char[]>());
+    std::memcpy(img.get(), bytes.data(), bytes.size());
+    return fromImage(std::move(img), bytes.size(), error);
+#endif
+}
+
+} // namespace dlexer
@@ -0,0 +1,69 @@
+#include <dlexer/regex.hpp>
+#include <dlexer/common.hpp>
+
+namespace dlexer {
+
+using namespace dtl;
+
+void RegexLexer::feed(const char* chunk, size_t len, const Sink& sink) {
+    feed(chunk, len, pushState, sink);
+}
+
+void RegexLexer::finish(const Sink& sink) {
+    finish(pushState, sink);
+}
+
+void RegexLexer::feed(const char* chunk, size_t len, PushState& state, const Sink& sink) const {
+    state.buf.append(chunk, len);
+    pushTokens(state, sink, false);
+}
+
+// data keeps its settings, as feed() rewinds it to the buffer anyway
+void RegexLexer::finish(PushState& state, const Sink& sink) const {
+    pushTokens(state, sink, true);
+    state.buf.clear();
+    state.from = 0;
+}
+
+// Runs getToken() over the buffer from state.from. Unless final, a unit
+// split by the end of the buffer is left out, and tokens stop at the first
+// one an attempt looked past the end for: matching resumes at the earliest
+// attempt that did, as all attempts before it fail whatever comes next.
+void RegexLexer::pushTokens(PushState& state, const Sink& sink, bool final) const {
+    RegexData& data = state.data;
+    data.str = state.buf.data();
+    data.strLen = final ? state.buf.size() : completeUnitsLength(state.buf.data(), state.buf.size());
+    data.rewindTo(state.from);
+
+    while(true) {
+        const char* start;
+        const char* end;
+        const bool res = getToken(&start, &end, data);
+        // attempts starting after the token don't change it; the NFA
+        // engine runs them along with the one that matched
+        if(!final && data.hitEnd && (!res || data.hitEndStart <= start - data.str)) {
+            state.from = data.hitEndStart;
+            break;
+        }
+        if(data.status != RegexData::OK) {
+            if(data.extractUnit()) { continue; }
+            state.from = data.pos;
+            break;
+        }
+        if(!res) {
+            state.from = data.strLen;
+            break;
+        }
+        sink(start, end, data);
+    }
+    if(final) { return; }
+
+    // one unit before the position is kept, so that rewindTo() sees
+    // whether it follows a newline
+    size_t keep = state.from;
+    if(keep != 0) { keep -= unitLengthLast(state.buf.data() + keep - 1); }
+    state.buf.erase(0, keep);
+    state.from -= keep;
+}
+
+} // namespace dlexer
@@ -0,0 +1,30 @@
+#ifndef DLEXER_REGEXSTATS_H_
+#define DLEXER_REGEXSTATS_H_
+#include <dlexer/regex.hpp>
+#include <algorithm>
+
+// RegexStats and RegexProfile hooks of the RegexLexer engines; they
+// compile to nothing unless dlexer is built with DLEXER_STATS
+
+#ifdef DLEXER_STATS
+#define STAT_COUNT(data, field) ((data).stats.token.field++, (data).stats.total.field++)
+#define STAT_NODE(data, id, field) do { \
+    if((data).profile != nullptr) { (data).profile->nodes[id].field++; } \
+} while(0)
+#define STAT_DEPTH(data) do { \
+    const uint64_t depth = (data).stack.size(); \
+    RegexStats& s = (data).stats; \
+    s.token.maxStackDepth = std::max(s.token.maxStackDepth, depth); \
+    s.total.maxStackDepth = std::max(s.total.maxStackDepth, depth); \
+} while(0)
+#define STAT_ADD(data, field, n) ((data).stats.token.field += (n), (data).stats.total.field += (n))
+#define STAT_TOKEN(data) ((data).stats.tokens++)
+#else
+#define STAT_COUNT(data, field) ((void)0)
+#define STAT_NODE(data, id, field) ((void)0)
+#define STAT_DEPTH(data) ((void)0)
+#define STAT_ADD(data, field, n) ((void)(n))
+#define STAT_TOKEN(data) ((void)0)
+#endif
+
+#endif // DLEXER_REGEXSTATS_H_
@@ -0,0 +1,77 @@
+    default: break;
+    }
+    return NOT_BOUND;
+}
+
+inline bool getToken(std::string& out, std::istream& in, char* unit, char& includePrevMode) {
+    if(in.eof()) {
+        return false;
+    } 
+
+    out.clear();
+
+    int justIncludedMode = NO_INCLUDE;
+    while(true) {
+        justIncludedMode = includePrevMode;
+        if(includePrevMode == RIGHT_INCLUDE) {
+            out.append(unit, unitLength(unit[0]));
+            includePrevMode = NO_INCLUDE;
+        } else if(includePrevMode == STANDALONE || includePrevMode == WEAK_STANDALONE) {
+            out.append(unit, unitLength(unit[0]));
+            includePrevMode = NO_INCLUDE;
+            return true;
+        }
+
+        const int ulen = extractUnit(unit, in);
+
+        if(in.eof()) {
+            return out.length() != 0;
+        }
+
+        switch(includeTypeOf(unit, ulen)) {
+        case NOT_BOUND: out.append(unit, ulen); break;
+        case NO_INCLUDE: {
+            if(out.length() == 0) {
+                continue;
+            }
+            return true;
+        }
+        case LEFT_INCLUDE: out.append(unit, ulen); return true;
+        case RIGHT_INCLUDE: {
+            includePrevMode = RIGHT_INCLUDE;
+            if(out.length() == 0) {
+                continue;
+            }
+            return true;
+        }
+        case STANDALONE: {
+            includePrevMode = STANDALONE;
+            if(out.length() == 0) {
+                continue;
+            }
+            return true;
+        }
+        case WEAK_STANDALONE: {
+            includePrevMode = WEAK_STANDALONE;
+            if(out.length() == 0 || justIncludedMode == RIGHT_INCLUDE) {
+                continue;
+            }
+            return true;
+        }
+        } // switch
+    } // while true
+}
+
+} // namespace DLEXER_GEN_NAMESPACE
+
+#ifndef DLEXER_NO_MAIN
+int main() {
+    std::string token;
+    char unit[4];
+    char includePrevMode = DLEXER_GEN_NAMESPACE::NO_INCLUDE;
+
+    while(DLEXER_GEN_NAMESPACE::getToken(token, std::cin, unit, includePrevMode)) {
+        std::cout << token << '\n';
+    }
+}
+#endif
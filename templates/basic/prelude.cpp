@@ -0,0 +1,44 @@
+#include <iostream>
+#include <string>
+#include <cstring>
+
+#ifndef DLEXER_GEN_NAMESPACE
+#define DLEXER_GEN_NAMESPACE dlexer_gen
+#endif
+
+namespace DLEXER_GEN_NAMESPACE {
+
+enum IncludeType: char {
+    NO_INCLUDE,
+    LEFT_INCLUDE,
+    RIGHT_INCLUDE,
+    STANDALONE,
+    WEAK_STANDALONE,
+    NOT_BOUND,
+};
+
+inline int unitLength(char first) {
+    int ind = 0;
+    while(first & (1 << (8*sizeof(char) - 1 - ind))) { 
+        ind++;
+    }
+
+    return ind + (ind == 0);
+}
+
+inline int extractUnit(char* dst, std::istream& src) {
+    const char& first = dst[0] = src.get();
+
+    if(src.eof()) {
+        return 0;
+    }
+
+    const int len = unitLength(first);
+    for(int i = 1; i < len; ++i) {
+        dst[i] = src.get();
+    }
+    return len;
+}
+
+inline IncludeType includeTypeOf(const char* unit, int ulen) {
+    switch(static_cast<unsigned char>(unit[0])) {
@@ -17,6 +17,7 @@ int getToken(
 }
 
 
+#ifndef DLEXER_NO_MAIN
 #define GROUPSIZE 6
 int main() {
     const char str[] = "aa 123 abc вzбя";
@@ -38,3 +39,4 @@ int main() {
         printf("\n");
     }
 }
+#endif
@@ -0,0 +1,57 @@
+
+inline int typeOf(const char* unit, int ulen) {
+    const int t = byteType[static_cast<unsigned char>(unit[0])];
+    if(t != -2) { return t; }
+
+    unsigned key = 0;
+    for(int i = 0; i < ulen; ++i) {
+        key = (key << 8) | static_cast<unsigned char>(unit[i]);
+    }
+    return multiType(key);
+}
+
+// Calls emit(type, start, end) for every maximal run of units of the same
+// type; units without type separate runs and are skipped.
+template<typename Emit>
+inline void scan(const char* str, size_t len, Emit&& emit) {
+    size_t pos = 0;
+    size_t start = 0;
+    int curType = -1;
+
+    while(pos < len) {
+        const unsigned char first = static_cast<unsigned char>(str[pos]);
+        if(first < 0x80 && byteType[first] == curType && curType != -1) {
+            ++pos;
+            continue;
+        }
+
+        int ulen = unitLength(str[pos]);
+        if(pos + ulen > len) { ulen = len - pos; }
+
+        const int t = typeOf(str + pos, ulen);
+        if(t != curType) {
+            if(curType != -1) { emit(curType, str + start, str + pos); }
+            curType = t;
+            start = pos;
+        }
+        pos += ulen;
+    }
+    if(curType != -1) { emit(curType, str + start, str + len); }
+}
+
+} // namespace DLEXER_GEN_NAMESPACE
+
+#ifndef DLEXER_NO_MAIN
+int main() {
+    const std::string in(
+        (std::istreambuf_iterator<char>(std::cin)),
+        (std::istreambuf_iterator<char>())
+    );
+
+    DLEXER_GEN_NAMESPACE::scan(in.data(), in.size(), [](int type, const char* start, const char* end) {
+        std::cout << DLEXER_GEN_NAMESPACE::typeNames[type] << '\t';
+        std::cout.write(start, end - start);
+        std::cout << '\n';
+    });
+}
+#endif
@@ -0,0 +1,21 @@
+#include <iostream>
+#include <iterator>
+#include <string>
+
+#ifndef DLEXER_GEN_NAMESPACE
+#define DLEXER_GEN_NAMESPACE dlexer_gen
+#endif
+
+namespace DLEXER_GEN_NAMESPACE {
+
+inline int unitLength(char first) {
+    int ind = 0;
+    while(first & (1 << (8*sizeof(char) - 1 - ind))) { 
+        ind++;
+    }
+
+    return ind + (ind == 0);
+}
+
+// -1: unit has no type
+// -2: multibyte unit, resolved by multiType()
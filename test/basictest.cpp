@@ -1,9 +1,108 @@
 #include <dlexer/basic.hpp>
+#include <dlexer/static_basic.hpp>
 #include "common.hpp"
 #include <sstream>
+#include <algorithm>
+#include <fstream>
 
 using namespace dlexer;
 
+static std::vector<std::string> tokenizeDynamic(const std::string& pat, const std::string& str) {
+    BasicLexer l(pat);
+    std::stringstream in(str);
+    std::vector<std::string> res;
+    std::string cur;
+    while(l.getToken(cur, in)) { res.push_back(cur); }
+    return res;
+}
+
+// static_basic must produce the same tokens as BasicLexer
+template<const char* Pat>
+int compareWithStatic(const std::string& str) {
+    static_basic<Pat> l;
+    std::stringstream in(str);
+    std::vector<std::string> res;
+    std::string cur;
+    while(l.getToken(cur, in)) { res.push_back(cur); }
+
+    if(res != tokenizeDynamic(Pat, str)) {
+        std::cerr << "FAIL AT STATIC PATTERN: \"" << Pat << "\", STRING: \"" << str << "\"\n";
+        return 1;
+    }
+    return 0;
+}
+
+// generated program must print the same tokens as BasicLexer, one per line
+int compareWithGenerated(const std::string& pat, const std::string& str) {
+    const std::string path = "basic_gen.cpp";
+    {
+        std::ofstream out(path);
+        BasicLexer(pat).writeAsCppProgram(out);
+    }
+
+    std::string desired;
+    for(const std::string& token: tokenizeDynamic(pat, str)) {
+        desired += token;
+        desired += '\n';
+    }
+
+    std::string res;
+    if(!runGeneratedProgram(path, str, res) || res != desired) {
+        std::cerr << "FAIL AT GENERATED PATTERN: \"" << pat << "\", STRING: \"" << str << "\"\n"
+            << "desired:\n" << desired << "res:\n" << res;
+        return 1;
+    }
+    return 0;
+}
+
+// feed() must give the same tokens as getToken() however the input is
+// split, also inside units
+int comparePush(const std::string& pat, const std::string& str) {
+    const std::vector<std::string> desired = tokenizeDynamic(pat, str);
+    BasicLexer l(pat);
+    for(size_t chunk = 1; chunk <= 5; ++chunk) {
+        std::vector<std::string> res;
+        auto sink = [&](const std::string& token) { res.push_back(token); };
+        for(size_t i = 0; i < str.size(); i += chunk) {
+            l.feed(str.data() + i, std::min(chunk, str.size() - i), sink);
+        }
+        l.finish(sink);
+
+        if(res != desired) {
+            std::cerr << "FAIL AT PUSH PATTERN: \"" << pat << "\", STRING: \"" << str
+                << "\", CHUNK: " << chunk << "\n";
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// tokens() must give views of the string with the same tokens as getToken()
+int compareRange(const std::string& pat, const std::string& str) {
+    BasicLexer l(pat);
+    std::vector<std::string> res;
+    for(const std::string_view token: l.tokens(str)) {
+        if(token.data() < str.data() || token.data() + token.size() > str.data() + str.size()) {
+            std::cerr << "FAIL AT RANGE PATTERN: \"" << pat << "\", token isn't a view of the string\n";
+            return 1;
+        }
+        res.emplace_back(token);
+    }
+    const auto range = l.tokens(str);
+    if(res != tokenizeDynamic(pat, str)
+    || std::distance(range.begin(), range.end()) != static_cast<std::ptrdiff_t>(res.size())) {
+        std::cerr << "FAIL AT RANGE PATTERN: \"" << pat << "\", STRING: \"" << str << "\"\n";
+        return 1;
+    }
+    return 0;
+}
+
+static constexpr char space[] = " ";
+static constexpr char leftInclude[] = " <";
+static constexpr char rightInclude[] = " >";
+static constexpr char escaped[] = "\\\\>\"!";
+static constexpr char utf[] = " ж^я!";
+
 int main() {
     LexerTestCase t = LexerTestCase::create(
         " ",
@@ -89,5 +188,29 @@ int main() {
     );
     fail |= t.testAndLog<BasicLexer>();
 
+    fail |= compareWithStatic<space>("abc abc");
+    fail |= compareWithStatic<leftInclude>("abc abc");
+    fail |= compareWithStatic<rightInclude>(" abc abc");
+    fail |= compareWithStatic<escaped>("abc\\\"abc");
+    fail |= compareWithStatic<utf>("abжcd яef ж");
+
+    fail |= compareWithGenerated(" ", "abc abc");
+    fail |= compareWithGenerated(" <", "abc abc");
+    fail |= compareWithGenerated(" >", " abc abc");
+    fail |= compareWithGenerated("\\\\>\"!", "abc\\\"abc");
+    fail |= compareWithGenerated(" ж^я!", "abжcd яef ж");
+
+    fail |= comparePush(" ", "abc  abc ");
+    fail |= comparePush(" <", "abc abc");
+    fail |= comparePush(" >", " abc abc");
+    fail |= comparePush("\\\\>\"!", "abc\\\"abc\"");
+    fail |= comparePush(" ж^я!", "abжcd яef ж");
+
+    fail |= compareRange(" ", "abc  abc ");
+    fail |= compareRange(" <", "abc abc");
+    fail |= compareRange(" >", " abc abc>");
+    fail |= compareRange("\\\\>\"!", "abc\\\"abc\"");
+    fail |= compareRange(" ж^я!", "abжcd яef ж");
+
     return fail;
 }
@@ -2,6 +2,8 @@
 #include <vector>
 #include <string>
 #include <iostream>
+#include <fstream>
+#include <cstdlib>
 
 struct LexerTestCase {
     std::string pat;
@@ -88,3 +90,32 @@ struct LexerTestCase {
         out << "] = res\n";
     }
 };
+
+#ifdef DLEXER_TEST_CXX
+// Compiles generated C++ program at `srcPath`, runs it with `input` on stdin
+// and stores its stdout to `output`. Paths are relative to working directory.
+inline bool runGeneratedProgram(const std::string& srcPath, const std::string& input, std::string& output) {
+    const std::string bin = srcPath + ".out";
+    const std::string in = srcPath + ".in";
+    const std::string res = srcPath + ".res";
+
+    const std::string compile = std::string(DLEXER_TEST_CXX) + " -std=c++17 -O1 -o " + bin + " " + srcPath;
+    if(std::system(compile.c_str()) != 0) {
+        std::cerr << "failed to compile generated program: " << compile << '\n';
+        return false;
+    }
+
+    std::ofstream(in) << input;
+    const std::string run = "./" + bin + " < " + in + " > " + res;
+    if(std::system(run.c_str()) != 0) {
+        std::cerr << "failed to run generated program: " << run << '\n';
+        return false;
+    }
+
+    std::ifstream ifs(res);
+    std::stringstream sstr;
+    sstr << ifs.rdbuf();
+    output = sstr.str();
+    return true;
+}
+#endif
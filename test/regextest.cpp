@@ -1,5 +1,12 @@
 #include <dlexer/regex.hpp>
+#include <dlexer/regexcache.hpp>
+#include <dlexer/blockreader.hpp>
+#include <dlexer/batchlexer.hpp>
 #include "common.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
 
 using namespace dlexer;
 
@@ -45,6 +52,1171 @@ int testGroups() {
     return 0;
 }
 
+int testImage() {
+    const std::string pat = "([а-я]+)$|^d|([a-z]+)|[^0-9 ]+";
+    const std::string str = "d d ааа ббб\nabc 123 #! ок";
+    const std::string path = "regextest_image.bin";
+
+    RegexLexer l(pat);
+    if(!l.writeImage(path)) {
+        std::cerr << "can't write image\n";
+        return 1;
+    }
+
+    std::string err;
+    auto loaded = RegexLexer::fromImageFile(path, &err);
+    if(!loaded) {
+        std::cerr << "can't load image: " << err << '\n';
+        return 1;
+    }
+    if(loaded->getPattern() != pat || loaded->getGroupCount() != l.getGroupCount()) {
+        std::cerr << "loaded image has different pattern or group count\n";
+        return 1;
+    }
+
+    RegexData data(str);
+    RegexData loadedData(str);
+    std::string out;
+    std::string loadedOut;
+    while(true) {
+        const bool res = l.getToken(out, data);
+        if(res != loaded->getToken(loadedOut, loadedData)) {
+            std::cerr << "image lexer token presence mismatch\n";
+            return 1;
+        }
+        if(!res) { break; }
+
+        if(out != loadedOut) {
+            std::cerr << "image lexer mismatch, desired = " << out << "\nres = " << loadedOut << '\n';
+            return 1;
+        }
+        for(int g = 0; g < l.getGroupCount(); ++g) {
+            if(data.groups[g].start != loadedData.groups[g].start
+            || data.groups[g].end != loadedData.groups[g].end) {
+                std::cerr << "image lexer group mismatch at " << out << '\n';
+                return 1;
+            }
+        }
+    }
+
+    std::string img = l.getImage();
+    img[0] = 'X';
+    std::shared_ptr<char> bad(new char[img.size()], std::default_delete<char[]>());
+    std::memcpy(bad.get(), img.data(), img.size());
+    if(RegexLexer::fromImage(bad, img.size(), &err) != nullptr) {
+        std::cerr << "corrupted image must be rejected\n";
+        return 1;
+    }
+
+    // the analysis and bit tables are loaded, not computed again
+    const RegexLexer onePass("([a-z]+)=([0-9]+)");
+    std::string onePassImg = onePass.getImage();
+    std::shared_ptr<char> copy(new char[onePassImg.size()], std::default_delete<char[]>());
+    std::memcpy(copy.get(), onePassImg.data(), onePassImg.size());
+    auto onePassLoaded = RegexLexer::fromImage(copy, onePassImg.size(), &err);
+    if(!onePassLoaded) {
+        std::cerr << "can't load one-pass image: " << err << '\n';
+        return 1;
+    }
+    const RegexAnalysis& a = onePass.getAnalysis();
+    const RegexAnalysis& loadedA = onePassLoaded->getAnalysis();
+    if(loadedA.engine != RegexAnalysis::ONEPASS || loadedA.features != a.features
+    || loadedA.stackDepth != a.stackDepth || loadedA.maxTokenLength != a.maxTokenLength
+    || loadedA.maxLookahead != a.maxLookahead) {
+        std::cerr << "loaded image has different analysis\n";
+        return 1;
+    }
+    const std::string kv = "abc=123 x=";
+    RegexData kvData(kv);
+    if(!onePassLoaded->getToken(out, kvData) || out != "abc=123"
+    || kvData.groups[1].start != 4 || kvData.groups[1].end != 7) {
+        std::cerr << "loaded one-pass image mismatch\n";
+        return 1;
+    }
+
+    const dtl::ProgHeader& h = *reinterpret_cast<const dtl::ProgHeader*>(onePassImg.data());
+    onePassImg[h.byteClassOffset] = '\xff';
+    onePassImg[h.byteClassOffset + 1] = '\xff';
+    std::shared_ptr<char> badBits(new char[onePassImg.size()], std::default_delete<char[]>());
+    std::memcpy(badBits.get(), onePassImg.data(), onePassImg.size());
+    if(RegexLexer::fromImage(badBits, onePassImg.size(), &err) != nullptr) {
+        std::cerr << "image with invalid unit classes must be rejected\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+int testCache() {
+    RegexCache& cache = RegexCache::global();
+    cache.setCapacity(1 << 20);
+
+    const std::string str = "abc 123 a1";
+    RegexLexer first("([a-z]+)|([0-9]+)");
+    RegexLexer second("([a-z]+)|([0-9]+)");
+    RegexLexer other("[a-z]+");
+    other.reprogram("([a-z]+)|([0-9]+)");
+
+    RegexCache::Stats stats = cache.getStats();
+    if(stats.hits != 2 || stats.misses != 2 || stats.entries != 2) {
+        std::cerr << "cache stats mismatch: hits = " << stats.hits
+            << ", misses = " << stats.misses << ", entries = " << stats.entries << '\n';
+        return 1;
+    }
+    // a hit takes the analysis from the image
+    for(const RegexLexer* l: { &second, &other }) {
+        const RegexAnalysis& a = l->getAnalysis();
+        if(a.engine != RegexAnalysis::ONEPASS || a.features != first.getAnalysis().features
+        || a.stackDepth != first.getAnalysis().stackDepth) {
+            std::cerr << "cached lexer analysis mismatch\n";
+            return 1;
+        }
+    }
+
+    for(RegexLexer* l: { &second, &other }) {
+        RegexData data(str);
+        RegexData firstData(str);
+        std::string out;
+        std::string firstOut;
+        while(first.getToken(firstOut, firstData)) {
+            if(!l->getToken(out, data) || out != firstOut || l->getGroupCount() != 2
+            || data.groups[0].start != firstData.groups[0].start
+            || data.groups[1].end != firstData.groups[1].end) {
+                std::cerr << "cached lexer mismatch at " << firstOut << '\n';
+                return 1;
+            }
+        }
+    }
+
+    // "[a-z]+" is the least recently used entry
+    cache.setCapacity(stats.bytes - 1);
+    RegexLexer third("([a-z]+)|([0-9]+)");
+    stats = cache.getStats();
+    if(stats.entries != 1 || stats.evictions != 1 || stats.hits != 3) {
+        std::cerr << "cache must evict least recently used entry\n";
+        return 1;
+    }
+
+    cache.setCapacity(0);
+    cache.clear();
+    return 0;
+}
+
+int testStats() {
+    const std::string str = "aab";
+    for(const unsigned flags: { RegexLexer::NO_FLAGS, RegexLexer::NFA, RegexLexer::BACKTRACK }) {
+        RegexLexer l("ab", flags);
+        RegexData data(str);
+        std::string out;
+        while(l.getToken(out, data)) {}
+
+        const RegexStats stats = data.getStats();
+        if(!RegexStats::enabled) {
+            if(stats.tokens != 0 || stats.total.steps != 0) {
+                std::cerr << "stats must be zero when DLEXER_STATS is off\n";
+                return 1;
+            }
+            continue;
+        }
+
+        // "a" at 0 is a failed start; the token of the last call is
+        // only its failed attempts
+        const bool backtracker = flags == RegexLexer::BACKTRACK;
+        if(stats.tokens != 1 || stats.total.failedStarts < 1 || stats.total.unitsFetched < 3
+        || stats.total.steps <= stats.token.steps
+        || (backtracker && (stats.total.backtracks < 1 || stats.total.maxStackDepth < 2))) {
+            std::cerr << "stats mismatch with flags " << flags << ": tokens = " << stats.tokens
+                << ", failedStarts = " << stats.total.failedStarts
+                << ", backtracks = " << stats.total.backtracks
+                << ", unitsFetched = " << stats.total.unitsFetched
+                << ", maxStackDepth = " << stats.total.maxStackDepth << '\n';
+            return 1;
+        }
+
+        data.resetStats();
+        if(data.getStats().total.steps != 0) {
+            std::cerr << "stats must be zero after reset\n";
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int testProfile() {
+    RegexLexer l("(a|b)*c|ab");
+    const std::string str = "ababab ab";
+    RegexData data(str);
+    RegexProfile profile;
+    data.setProfile(&profile);
+
+    std::string out;
+    while(l.getToken(out, data)) {}
+
+    const std::string report = l.profileReport(profile);
+    std::ostringstream dot;
+    l.writeProfileDot(dot, profile);
+    if(report.find("pattern: (a|b)*c|ab\n") != 0 || dot.str().find("digraph") != 0) {
+        std::cerr << "bad profile report:\n" << report << dot.str();
+        return 1;
+    }
+    if(!RegexStats::enabled) { return 0; }
+
+    // 'c' is tried after every "a" or "b" and mostly fails
+    const size_t at = report.find("UnitNode 'c'");
+    const size_t lineStart = report.rfind('\n', at) + 1;
+    const std::string line = report.substr(lineStart, report.find('\n', at) - lineStart);
+    const std::string caret = std::string(sizeof("pattern: ") - 1 + 6, ' ') + "^ ";
+    if(at == std::string::npos || line.find(caret) != 0 || line.find("fails 0") != std::string::npos) {
+        std::cerr << "profile report must point at 'c':\n" << report;
+        return 1;
+    }
+    return 0;
+}
+
+int testLimits() {
+    // every "a" may be taken by both alternatives, so failing to find "b"
+    // takes exponential number of steps
+    RegexLexer l("(a|a)*b|c", RegexLexer::BACKTRACK);
+    const std::string str = "ab aaaaaaaaaaaa c";
+    RegexData data(str);
+    data.stepBudget = 100;
+
+    std::string out;
+    if(!l.getToken(out, data) || out != "ab" || data.status != RegexData::OK) {
+        std::cerr << "budget must not affect cheap tokens\n";
+        return 1;
+    }
+    if(l.getToken(out, data) || data.status != RegexData::STEP_BUDGET_EXCEEDED || data.pos != 3) {
+        std::cerr << "step budget must abort at token start, pos = " << data.pos << '\n';
+        return 1;
+    }
+
+    data.stepBudget = 0;
+    data.timeBudget = std::chrono::nanoseconds(1);
+    if(l.getToken(out, data) || data.status != RegexData::DEADLINE_EXCEEDED || data.pos != 3) {
+        std::cerr << "deadline must abort at token start, pos = " << data.pos << '\n';
+        return 1;
+    }
+
+    // resumes as if nothing happened
+    data.timeBudget = std::chrono::nanoseconds(0);
+    if(!l.getToken(out, data) || out != "c" || data.status != RegexData::OK || l.getToken(out, data)) {
+        std::cerr << "aborted data must be resumable\n";
+        return 1;
+    }
+    return 0;
+}
+
+int testStackLimit() {
+    // start, 'a', 'b', 'c' and start, OrNode, 'b', 'c'
+    if(RegexLexer("abc").getAnalysis().stackDepth != 4 || RegexLexer("a|bc").getAnalysis().stackDepth != 4
+    || RegexLexer("(ab)*c").getAnalysis().stackDepth != 0) {
+        std::cerr << "wrong stack depth analysis\n";
+        return 1;
+    }
+
+    RegexLexer l("(ab)*c|x", RegexLexer::BACKTRACK);
+    std::string str = "x ";
+    for(int i = 0; i < 1000; ++i) { str += "ab"; }
+    str += "c x";
+    RegexData data(str);
+    data.stackLimit = 100;
+
+    std::string out;
+    if(!l.getToken(out, data) || out != "x") {
+        std::cerr << "stack limit must not affect short tokens\n";
+        return 1;
+    }
+    if(l.getToken(out, data) || data.status != RegexData::STACK_LIMIT_EXCEEDED || data.pos != 2) {
+        std::cerr << "stack limit must abort at token start, pos = " << data.pos << '\n';
+        return 1;
+    }
+
+    data.stackLimit = 0;
+    if(!l.getToken(out, data) || out.size() != 2001 || !l.getToken(out, data) || out != "x") {
+        std::cerr << "aborted data must be resumable without stack limit\n";
+        return 1;
+    }
+    return 0;
+}
+
+int testLengthBounds() {
+    struct Case {
+        const char* pat;
+        size_t maxTokenLength;
+        size_t maxLookahead;
+    };
+    const std::vector<Case> cases = {
+        { "abc", 3, 0 },
+        { "ab|a", 2, 1 },
+        { "a$", 1, 1 },
+        { "x(y|yz)$", 3, 2 },
+        { "я?b", 2, 1 },
+        { "(ab)*c", RegexAnalysis::Unbounded, RegexAnalysis::Unbounded },
+    };
+    for(const Case& c: cases) {
+        const RegexLexer lexer(c.pat);
+        const RegexAnalysis& a = lexer.getAnalysis();
+        if(a.maxTokenLength != c.maxTokenLength || a.maxLookahead != c.maxLookahead) {
+            std::cerr << "length bounds of " << c.pat << ": token " << a.maxTokenLength
+                << ", lookahead " << a.maxLookahead << '\n';
+            return 1;
+        }
+    }
+
+    // the stream window is bounded, however the input is split
+    RegexLexer l("ab|abcd|x");
+    const RegexAnalysis& a = l.getAnalysis();
+    const size_t window = 4 * (a.maxTokenLength + a.maxLookahead + 2);
+    const std::string str = "abcabcdxabcabyyabcdab";
+    RegexLexer::PushState state;
+    size_t count = 0;
+    auto sink = [&](const char*, const char*, RegexData&) { count++; };
+    for(size_t i = 0; i < str.size(); ++i) {
+        l.feed(str.data() + i, 1, state, sink);
+        if(state.buf.size() > window) {
+            std::cerr << "push buffer " << state.buf << " is over the window of " << window << '\n';
+            return 1;
+        }
+    }
+    l.finish(state, sink);
+    if(count != 7) {
+        std::cerr << "windowed push gave " << count << " tokens\n";
+        return 1;
+    }
+    return 0;
+}
+
+int testMemoize() {
+    // without memoization, first two take exponential number of steps,
+    // so they are checked against expected tokens
+    const std::vector<std::pair<std::string, std::string>> exponential = {
+        { "(a|a)*b|c", "ab aaaaaaaaaaaaaaaaaaaaaaaaaaaaaa c" },
+        { "(a*)*b", "aaaaaaaaaaaaaaaaaaaaaaaa aab" },
+    };
+    const std::vector<std::vector<std::string>> expected = {
+        { "ab", "c" },
+        { "aab" },
+    };
+    for(int i = 0; i < exponential.size(); ++i) {
+        RegexLexer l(exponential[i].first, RegexLexer::MEMOIZE);
+        RegexData data(exponential[i].second);
+        data.stepBudget = 10000;
+
+        std::vector<std::string> tokens;
+        std::string out;
+        while(l.getToken(out, data)) { tokens.push_back(out); }
+        if(data.status != RegexData::OK || tokens != expected[i]) {
+            std::cerr << "memoized " << exponential[i].first << " mismatch or exceeded step budget\n";
+            return 1;
+        }
+    }
+
+    // tokens and groups must be the backtracker's, also where groups
+    // are reset by attempts that memoization prunes
+    const std::vector<std::pair<std::string, std::string>> cases = {
+        { "([a-z]+)|([0-9]+)", "abc 123 a1" },
+        { "a+?b|^x$", "aaab\nx\nx x" },
+        { "[^a-c ]+|b*", "bbb xyz ab" },
+        { "b+(a*((c|[ab]*c+a+?))+a)+|[ab]a", " aa " },
+        { "([ab]+a+|(b+)+?)+a([ab]+?ba+?)*", "aacccc " },
+    };
+    for(const auto& c: cases) {
+        RegexLexer memoized(c.first, RegexLexer::MEMOIZE);
+        RegexLexer plain(c.first, RegexLexer::BACKTRACK);
+        RegexData data(c.second);
+        RegexData plainData(c.second);
+
+        while(true) {
+            const char* start;
+            const char* end;
+            const char* plainStart;
+            const char* plainEnd;
+            const bool res = memoized.getToken(&start, &end, data);
+            if(res != plain.getToken(&plainStart, &plainEnd, plainData)) {
+                std::cerr << "memoized " << c.first << " mismatch\n";
+                return 1;
+            }
+            if(!res) { break; }
+
+            // groups may be half reset, so positions are compared
+            auto describe = [&](const char* start, const char* end, const RegexData& data) {
+                std::string res(start, end);
+                for(const RegexData::Group& g: data.groups) {
+                    res += ' ' + std::to_string(g.start) + ':' + std::to_string(g.end);
+                }
+                return res;
+            };
+            const std::string desired = describe(plainStart, plainEnd, plainData);
+            const std::string out = describe(start, end, data);
+            if(out != desired) {
+                std::cerr << "memoized " << c.first << " mismatch, desired = "
+                    << desired << "\nres = " << out << '\n';
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+int testAnalysis() {
+    struct Case {
+        const char* pat;
+        uint32_t features;
+        RegexAnalysis::Engine engine;
+    };
+    const std::vector<Case> cases = {
+        { "(a+)+b", RegexAnalysis::CAPTURES | RegexAnalysis::EXPONENTIAL, RegexAnalysis::NFA },
+        { "(a|a)*c", RegexAnalysis::CAPTURES | RegexAnalysis::EXPONENTIAL, RegexAnalysis::NFA },
+        { "(a*)*b", RegexAnalysis::CAPTURES | RegexAnalysis::EXPONENTIAL, RegexAnalysis::NFA },
+        { "([a-z]+)|([0-9]+)", RegexAnalysis::CAPTURES, RegexAnalysis::ONEPASS },
+        { "(a|b)*c", RegexAnalysis::CAPTURES, RegexAnalysis::ONEPASS },
+        { "(a|ab)(c|bcd)(d*)", RegexAnalysis::CAPTURES, RegexAnalysis::BACKTRACK },
+        { "a*a*", 0, RegexAnalysis::BACKTRACK },
+        { "a+?b|^x$", RegexAnalysis::LAZY | RegexAnalysis::ANCHORS, RegexAnalysis::BACKTRACK },
+        { "[^a ]+", RegexAnalysis::NEGATED_CLASSES, RegexAnalysis::BITPARALLEL },
+        { "[a-z_]+|[0-9]+", 0, RegexAnalysis::BITPARALLEL },
+    };
+    for(const Case& c: cases) {
+        const RegexLexer lexer(c.pat);
+        const RegexAnalysis& a = lexer.getAnalysis();
+        const bool exponential = c.features & RegexAnalysis::EXPONENTIAL;
+        if(a.features != c.features || a.engine != c.engine || (a.ambiguousPos != -1) != exponential) {
+            std::cerr << "analysis mismatch for " << c.pat << ": features = " << a.features
+                << ", engine = " << a.engine << ", ambiguousPos = " << a.ambiguousPos << '\n';
+            return 1;
+        }
+    }
+
+    // start state of the product has a successor pair for every two
+    // of the 1100 units, more than the analysis may look at
+    std::string big;
+    std::vector<std::string> units;
+    for(uint32_t cp = 0x4e00; cp < 0x4e00 + 1100; ++cp) {
+        units.push_back(std::string{ static_cast<char>(0xe0 | (cp >> 12)),
+            static_cast<char>(0x80 | ((cp >> 6) & 0x3f)), static_cast<char>(0x80 | (cp & 0x3f)) });
+        big += (big.empty() ? "(" : "|") + units.back();
+    }
+    big += ")+";
+    const RegexLexer unanalyzed(big);
+    const RegexAnalysis& ua = unanalyzed.getAnalysis();
+    if(!ua.has(RegexAnalysis::UNANALYZED) || ua.engine != RegexAnalysis::NFA) {
+        std::cerr << "unanalyzed pattern must run under NFA engine: features = " << ua.features
+            << ", engine = " << ua.engine << '\n';
+        return 1;
+    }
+    const std::string bigStr = "x" + units[7] + units[1099] + units[0] + " " + units[3];
+    RegexData bigData(bigStr);
+    std::string bigOut;
+    if(!unanalyzed.getToken(bigOut, bigData) || bigOut != units[7] + units[1099] + units[0]
+    || bigData.groups[0].start != 7 || !unanalyzed.getToken(bigOut, bigData) || bigOut != units[3]) {
+        std::cerr << "unanalyzed pattern mismatch\n";
+        return 1;
+    }
+
+    if(RegexLexer("(a+)+b", RegexLexer::MEMOIZE).getAnalysis().engine != RegexAnalysis::BACKTRACK) {
+        std::cerr << "MEMOIZE must keep backtracking engine\n";
+        return 1;
+    }
+
+    // linear engine finds the same tokens and groups
+    const std::vector<std::pair<std::string, std::string>> same = {
+        { "([a-z]+)|([0-9]+)", "abc 123 a1" },
+        { "(a|ab)(c|bcd)(d*)", "abcd acd abcdd" },
+        { "a+?b|^x$", "aaab\nx\nx x" },
+        { "[^a-c ]+|b*", "bbb xyz ab" },
+        { "([а-ю]*?)я", "абвя абвабвя" },
+    };
+    for(const auto& c: same) {
+        RegexLexer nfa(c.first, RegexLexer::NFA);
+        RegexLexer bt(c.first, RegexLexer::BACKTRACK);
+        RegexData data(c.second);
+        RegexData btData(c.second);
+
+        std::string out;
+        std::string btOut;
+        while(true) {
+            const bool res = nfa.getToken(out, data);
+            if(res != bt.getToken(btOut, btData) || (res && out != btOut)) {
+                std::cerr << "NFA " << c.first << " mismatch, desired = " << btOut << "\nres = " << out << '\n';
+                return 1;
+            }
+            if(!res) { break; }
+            for(int g = 0; g < nfa.getGroupCount(); ++g) {
+                if(data.groups[g].start != btData.groups[g].start || data.groups[g].end != btData.groups[g].end) {
+                    std::cerr << "NFA " << c.first << " group mismatch at " << out << '\n';
+                    return 1;
+                }
+            }
+        }
+    }
+
+    RegexLexer l("(a+)+b|c");
+    const std::string str = std::string(1000, 'a') + "c";
+    RegexData data(str);
+    data.stepBudget = 100000;
+    std::string out;
+    if(!l.getToken(out, data) || out != "c" || data.status != RegexData::OK) {
+        std::cerr << "exponential pattern must run under NFA engine\n";
+        return 1;
+    }
+    return 0;
+}
+
+int testBits() {
+    const std::vector<std::pair<std::string, std::string>> same = {
+        { "[a-z_]+|[0-9]+", "abc 123 a1 _x" },
+        { "a+?b|c", "aaab aac b" },
+        { "x*y?", "xxy yx z" },
+        { "[^a ]+|a", "bca a\nba" },
+        { "[а-ю]*?я", "абвя абвабвя" },
+    };
+    for(const auto& c: same) {
+        RegexLexer bits(c.first);
+        RegexLexer bt(c.first, RegexLexer::BACKTRACK);
+        if(bits.getAnalysis().engine != RegexAnalysis::BITPARALLEL) {
+            std::cerr << c.first << " must run under bit-parallel engine\n";
+            return 1;
+        }
+
+        RegexData data(c.second);
+        RegexData btData(c.second);
+        std::string out;
+        std::string btOut;
+        while(true) {
+            const bool res = bits.getToken(out, data);
+            if(res != bt.getToken(btOut, btData) || (res && out != btOut)) {
+                std::cerr << "bit-parallel " << c.first << " mismatch, desired = " << btOut << "\nres = " << out << '\n';
+                return 1;
+            }
+            if(!res) { break; }
+        }
+    }
+    return 0;
+}
+
+int testOnePass() {
+    // groups of the last two are reverted by the backtracker after
+    // failed iterations, the same must be done in one pass
+    const std::vector<std::pair<std::string, std::string>> same = {
+        { "([a-z]+)=([0-9]+)", "abc=123 a=1 x=" },
+        { "(a)|(b)", "ab ba" },
+        { "(a(b)?)+c", "aabac abc ac" },
+        { "(a)*b", "aab ab b" },
+        { "((a)|b)+", "abba ab" },
+    };
+    for(const auto& c: same) {
+        RegexLexer onePass(c.first);
+        RegexLexer bt(c.first, RegexLexer::BACKTRACK);
+        if(onePass.getAnalysis().engine != RegexAnalysis::ONEPASS) {
+            std::cerr << c.first << " must run under one-pass engine\n";
+            return 1;
+        }
+
+        RegexData data(c.second);
+        RegexData btData(c.second);
+        std::string out;
+        std::string btOut;
+        while(true) {
+            const bool res = onePass.getToken(out, data);
+            if(res != bt.getToken(btOut, btData) || (res && out != btOut)) {
+                std::cerr << "one-pass " << c.first << " mismatch, desired = " << btOut << "\nres = " << out << '\n';
+                return 1;
+            }
+            if(!res) { break; }
+            for(int g = 0; g < onePass.getGroupCount(); ++g) {
+                if(data.groups[g].start != btData.groups[g].start || data.groups[g].end != btData.groups[g].end) {
+                    std::cerr << "one-pass " << c.first << " group mismatch at " << out << '\n';
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+int testLazyGroups() {
+    struct Case {
+        const char* pat;
+        unsigned flags;
+        const char* str;
+    };
+    const std::vector<Case> cases = {
+        { "([a-z]+)=([0-9]+)", RegexLexer::NO_FLAGS, "abc=123 a=1 x=" },
+        { "([a-z]+)=([0-9]+)", RegexLexer::BACKTRACK, "abc=123 a=1 x=" },
+        { "([a-z]+)=([0-9]+)", RegexLexer::NFA, "abc=123 a=1 x=" },
+        { "(a|ab)(c|bcd)(d*)", RegexLexer::NO_FLAGS, "abcd acd abcdd" },
+        { "(^a*)|(b)$", RegexLexer::NO_FLAGS, "aab\nb\nab" },
+        { "(x*)", RegexLexer::NFA, "xx y" },
+    };
+    for(const Case& c: cases) {
+        RegexLexer l(c.pat, c.flags);
+        const std::string str = c.str;
+        RegexData eager(str);
+        RegexData lazy(str);
+        lazy.lazyGroups = true;
+
+        std::string out;
+        std::string lazyOut;
+        while(true) {
+            const bool res = l.getToken(out, eager);
+            if(res != l.getToken(lazyOut, lazy) || (res && out != lazyOut)) {
+                std::cerr << "lazy groups " << c.pat << " token mismatch, desired = " << out << "\nres = " << lazyOut << '\n';
+                return 1;
+            }
+            if(!res) { break; }
+            if(!lazy.groups.empty()) {
+                std::cerr << "lazy groups " << c.pat << " must not be filled by getToken()\n";
+                return 1;
+            }
+
+            const std::vector<RegexData::Group>& groups = l.getGroups(lazy);
+            for(int g = 0; g < l.getGroupCount(); ++g) {
+                if(groups[g].start != eager.groups[g].start || groups[g].end != eager.groups[g].end) {
+                    std::cerr << "lazy groups " << c.pat << " group mismatch at " << out << '\n';
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+// token and group texts, "-" for a group that didn't participate
+static std::string describeToken(const char* start, const char* end, const char* str,
+    const std::vector<RegexData::Group>& groups
+) {
+    std::string res(start, end);
+    for(const RegexData::Group& g: groups) {
+        res += '|';
+        res += g.start == -1 ? std::string("-") : std::string(str + g.start, str + g.end);
+    }
+    return res;
+}
+
+int testPush() {
+    struct Case {
+        const char* pat;
+        unsigned flags;
+        const char* str;
+    };
+    const std::vector<Case> cases = {
+        { "[a-z]+", RegexLexer::NO_FLAGS, "abc de  f" },
+        { "([a-z]+)=([0-9]+)", RegexLexer::NO_FLAGS, "abc=123 a=1 x=" },
+        { "([a-z]+)=([0-9]+)", RegexLexer::BACKTRACK, "abc=123 a=1 x=" },
+        { "([a-z]+)=([0-9]+)", RegexLexer::NFA, "abc=123 a=1 x=" },
+        { "ab|a", RegexLexer::NO_FLAGS, "aab ba a" },
+        { "(a|ab)(c|bcd)(d*)", RegexLexer::MEMOIZE, "abcd acd abcdd" },
+        { "(^a*)|(b)$", RegexLexer::NO_FLAGS, "aab\nb\nab" },
+        { "(^|a)(b)", RegexLexer::NFA, "b ab\nbab" },
+        { "я+|x*", RegexLexer::NO_FLAGS, "яяxя x" },
+        { "[^a]+", RegexLexer::NO_FLAGS, "bяcab a" },
+    };
+    for(const Case& c: cases) {
+        RegexLexer l(c.pat, c.flags);
+        const std::string str = c.str;
+        RegexData data(str);
+        std::vector<std::string> desired;
+        const char* start;
+        const char* end;
+        while(l.getToken(&start, &end, data)) {
+            desired.push_back(describeToken(start, end, str.data(), data.groups));
+        }
+
+        for(size_t chunk = 1; chunk <= 5; ++chunk) {
+            std::vector<std::string> res;
+            auto sink = [&](const char* start, const char* end, RegexData& data) {
+                res.push_back(describeToken(start, end, data.str, l.getGroups(data)));
+            };
+            for(size_t i = 0; i < str.size(); i += chunk) {
+                l.feed(str.data() + i, std::min(chunk, str.size() - i), sink);
+            }
+            l.finish(sink);
+
+            if(res != desired) {
+                std::cerr << "push " << c.pat << " chunk " << chunk << " token mismatch, desired:";
+                for(const std::string& t: desired) { std::cerr << " [" << t << ']'; }
+                std::cerr << "\nres:";
+                for(const std::string& t: res) { std::cerr << " [" << t << ']'; }
+                std::cerr << '\n';
+                return 1;
+            }
+        }
+    }
+
+    // a token is given as soon as the input after it decides it, and the
+    // buffer doesn't keep what was consumed
+    RegexLexer l("[a-z]+");
+    RegexLexer::PushState state;
+    state.data.lazyGroups = true;
+    std::vector<std::string> res;
+    auto sink = [&](const char* start, const char* end, RegexData&) { res.emplace_back(start, end); };
+    l.feed("ab", 2, state, sink);
+    l.feed("c d", 3, state, sink);
+    if(res != std::vector<std::string>{ "abc" } || state.buf.size() > 2) {
+        std::cerr << "push must give \"abc\" after a space, buffer \"" << state.buf << "\"\n";
+        return 1;
+    }
+    l.finish(state, sink);
+    if(res != std::vector<std::string>{ "abc", "d" } || !state.buf.empty()) {
+        std::cerr << "push finish must give the last token and reset the state\n";
+        return 1;
+    }
+    return 0;
+}
+
+int testRange() {
+    const std::vector<std::pair<const char*, unsigned>> cases = {
+        { "([a-z]+)=([0-9]+)", RegexLexer::NO_FLAGS },
+        { "([a-z]+)=([0-9]+)", RegexLexer::NFA },
+        { "(a|ab)(c|bcd)(d*)", RegexLexer::BACKTRACK },
+        { "(x*)|(y)", RegexLexer::NO_FLAGS },
+    };
+    const std::string str = "abc=123 a=1 x=\nabcd acd abcdd yx";
+    for(const auto& c: cases) {
+        RegexLexer l(c.first, c.second);
+        RegexData data(str);
+        std::vector<std::string> desired;
+        const char* start;
+        const char* end;
+        while(l.getToken(&start, &end, data)) {
+            desired.push_back(describeToken(start, end, str.data(), data.groups));
+        }
+
+        for(const bool lazy: { false, true }) {
+            std::vector<std::string> res;
+            auto range = l.tokens(str);
+            range.data.lazyGroups = lazy;
+            for(const RegexLexer::Token& t: range) {
+                std::string token(t.text);
+                for(int g = 0; g < l.getGroupCount(); ++g) {
+                    const std::string_view group = t.group(g);
+                    token += '|';
+                    token += group.data() == nullptr ? std::string("-") : std::string(group);
+                }
+                res.push_back(token);
+            }
+            if(res != desired) {
+                std::cerr << "token range of " << c.first << " differs from getToken()\n";
+                return 1;
+            }
+        }
+    }
+
+    // works with standard algorithms
+    RegexLexer l("[0-9]+");
+    auto range = l.tokens(str);
+    const auto it = std::find_if(range.begin(), range.end(), [](const RegexLexer::Token& t) { return t.text == "1"; });
+    if(it == range.end() || it->text.data() != str.data() + 10) {
+        std::cerr << "token range must find a token view\n";
+        return 1;
+    }
+    return 0;
+}
+
+// text of a group view as describeToken() gives it
+static std::string describeGroup(std::string_view g) {
+    return g.data() == nullptr ? std::string("-") : std::string(g);
+}
+
+int testMatch() {
+    const std::vector<std::pair<const char*, unsigned>> cases = {
+        { "([a-z]+)=([0-9]+)", RegexLexer::NO_FLAGS },
+        { "(a|ab)(c|bcd)(d*)", RegexLexer::BACKTRACK },
+        { "(x*)|(y)", RegexLexer::NFA },
+        { "((a)|(b))+", RegexLexer::NO_FLAGS },
+    };
+    const std::string str = "abc=123 a=1 x=\nabcd acd abcdd yx abba";
+    for(const auto& c: cases) {
+        RegexLexer l(c.first, c.second);
+        RegexData data(str);
+        std::vector<std::string> desired;
+        const char* start;
+        const char* end;
+        while(l.getToken(&start, &end, data)) {
+            desired.push_back(describeToken(start, end, str.data(), data.groups));
+        }
+
+        for(const bool lazy: { false, true }) {
+            std::vector<std::string> res;
+            RegexData matchData(str);
+            matchData.lazyGroups = lazy;
+            RegexMatch<4> m;
+            while(l.getMatch(m, matchData)) {
+                std::string token(m.text);
+                for(size_t g = 0; g < m.groupCount; ++g) { token += '|' + describeGroup(m.groups[g]); }
+                res.push_back(token);
+            }
+            if(res != desired) {
+                std::cerr << "getMatch() of " << c.first << " differs from getToken()\n";
+                return 1;
+            }
+
+            // batches of 3 tokens
+            res.clear();
+            RegexData batchData(str);
+            batchData.lazyGroups = lazy;
+            RegexBatch batch;
+            while(l.getTokens(batch, batchData, 3) != 0) {
+                for(size_t k = 0; k < batch.size(); ++k) {
+                    std::string token(batch.token(k));
+                    for(int g = 0; g < l.getGroupCount(); ++g) {
+                        if(!batch.groupMatched(k, g) && !batch.group(k, g).empty()) {
+                            std::cerr << "batch group that didn't match must be empty\n";
+                            return 1;
+                        }
+                        token += '|' + (batch.groupMatched(k, g) ? std::string(batch.group(k, g)) : std::string("-"));
+                    }
+                    res.push_back(token);
+                }
+            }
+            if(res != desired) {
+                std::cerr << "getTokens() of " << c.first << " differs from getToken()\n";
+                return 1;
+            }
+        }
+    }
+
+    // groups past N are dropped
+    RegexLexer l("(a)(b)(c)");
+    const std::string abc = "abc";
+    RegexData data(abc);
+    RegexMatch<1> m;
+    if(!l.getMatch(m, data) || m.groupCount != 3 || m.groups[0] != "a") {
+        std::cerr << "getMatch() must keep the first groups\n";
+        return 1;
+    }
+    return 0;
+}
+
+// tokens of each record as describeToken() gives them
+static std::vector<std::vector<std::string>> describeBatch(const RecordBatch& batch) {
+    std::vector<std::vector<std::string>> res(batch.records());
+    for(size_t r = 0; r < batch.records(); ++r) {
+        for(size_t k = 0; k < batch.tokenCount(r); ++k) {
+            std::string token(batch.token(r, k));
+            for(size_t g = 0; g + 1 < batch.stride; ++g) {
+                token += '|' + (batch.groupMatched(r, k, g) ? std::string(batch.group(r, k, g)) : std::string("-"));
+            }
+            res[r].push_back(token);
+        }
+    }
+    return res;
+}
+
+// BatchLexer must give every record the tokens getToken() gives it alone,
+// whatever the number of threads
+int testBatchLexer() {
+    std::vector<std::string> texts;
+    for(int i = 0; i < 300; ++i) {
+        std::string t = "key" + std::to_string(i) + "=" + std::to_string(i * 7);
+        if(i % 3 == 0) { t += " x=\n"; }
+        if(i % 11 == 0) { t.clear(); }
+        texts.push_back(t);
+    }
+
+    RegexLexer l("([a-z]+)([0-9]*)=([0-9]+)?");
+    // tokens of each record
+    std::vector<std::vector<std::string>> desired;
+    for(const std::string& t: texts) {
+        desired.emplace_back();
+        RegexData data(t);
+        const char* start;
+        const char* end;
+        while(l.getToken(&start, &end, data)) {
+            desired.back().push_back(describeToken(start, end, t.data(), data.groups));
+        }
+    }
+
+    for(const unsigned threads: { 1u, 4u }) {
+        BatchLexer batchLexer(l, threads);
+        // the second batch is smaller, to reuse buffers of the first one
+        for(const size_t count: { texts.size(), size_t(70) }) {
+            const std::vector<std::string_view> records(texts.begin(), texts.begin() + count);
+            RecordBatch batch;
+            batchLexer.getTokens(records, batch);
+
+            if(describeBatch(batch) != std::vector<std::vector<std::string>>(desired.begin(), desired.begin() + count)) {
+                std::cerr << "BatchLexer with " << threads << " threads differs from getToken()\n";
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// line mode must lex every line as a string of its own
+int testLineTokens() {
+    const std::string text = "a=1 b=2\n\nab=\n=3 cd=45\nx\n";
+    const std::vector<std::string> lines = { "a=1 b=2", "", "ab=", "=3 cd=45", "x" };
+    RegexLexer l("^[a-z]+|([a-z]*)=([0-9]*)$|[0-9]");
+
+    std::vector<std::vector<std::string>> desired;
+    for(const std::string& line: lines) {
+        desired.emplace_back();
+        RegexData data(line);
+        const char* start;
+        const char* end;
+        while(l.getToken(&start, &end, data)) {
+            desired.back().push_back(describeToken(start, end, line.data(), data.groups));
+        }
+    }
+
+    for(const unsigned threads: { 1u, 3u }) {
+        BatchLexer batchLexer(l, threads);
+        RecordBatch batch;
+        batchLexer.getLineTokens(text, batch);
+
+        if(describeBatch(batch) != desired) {
+            std::cerr << "getLineTokens() with " << threads << " threads differs from getToken() over lines\n";
+            return 1;
+        }
+    }
+
+    std::vector<std::string_view> split;
+    BatchLexer::splitLines("a\n\nb", split);
+    if(split != std::vector<std::string_view>{ "a", "", "b" }) {
+        std::cerr << "splitLines() must keep empty lines and the last one\n";
+        return 1;
+    }
+    return 0;
+}
+
+// tokens taken from TokenCache must be the ones lexing gives
+int testTokenCache() {
+    std::vector<std::string> texts;
+    for(int i = 0; i < 400; ++i) {
+        texts.push_back("user" + std::to_string(i % 5) + "=" + std::to_string(i % 7) + (i % 2 ? " x" : ""));
+    }
+    texts.push_back("");
+    const std::vector<std::string_view> records(texts.begin(), texts.end());
+
+    RegexLexer l("([a-z]+)([0-9]*)=([0-9]+)?");
+    RecordBatch desired;
+    BatchLexer(l, 1).getTokens(records, desired);
+
+    for(const size_t capacity: { size_t(1) << 20, TokenCache::ShardCount * 60, size_t(0) }) {
+        TokenCache cache(capacity);
+        BatchLexer batchLexer(l, 3);
+        batchLexer.setCache(&cache);
+        TokenCache::Stats first = {};
+        for(int pass = 0; pass < 2; ++pass) {
+            RecordBatch batch;
+            batchLexer.getTokens(records, batch);
+            if(describeBatch(batch) != describeBatch(desired)) {
+                std::cerr << "tokens from TokenCache of " << capacity << " bytes differ\n";
+                return 1;
+            }
+            if(pass == 0) { first = cache.getStats(); }
+        }
+
+        const TokenCache::Stats stats = cache.getStats();
+        if(capacity == 0) {
+            if(stats.hits != 0 || stats.entries != 0) {
+                std::cerr << "TokenCache of 0 bytes must be disabled\n";
+                return 1;
+            }
+            continue;
+        }
+        if(stats.hits + stats.misses != 2 * records.size() || stats.bytes > capacity) {
+            std::cerr << "wrong TokenCache stats\n";
+            return 1;
+        }
+        // 2 * 5 * 7 + 1 distinct records fit the large cache. They are
+        // added on their second miss, threads may lex one of them at once
+        // in the first pass; the empty record is only seen once a pass,
+        // so it's added in the second one and missed no more
+        if(capacity == size_t(1) << 20 && (first.entries != 70 || stats.entries != 71
+        || stats.misses != first.misses + 1 || stats.evictions != 0)) {
+            std::cerr << "TokenCache must keep every distinct record\n";
+            return 1;
+        }
+        if(capacity != size_t(1) << 20 && stats.evictions == 0) {
+            std::cerr << "TokenCache must evict records past its capacity\n";
+            return 1;
+        }
+    }
+
+    // records seen once must not push out a recurring one
+    TokenCache cache(TokenCache::ShardCount * 60);
+    const RegexBatch::Span span = { 0, 4 };
+    const uint8_t matched = 1;
+    for(int i = 0; i < 2; ++i) { cache.insert("user", &span, &matched, 1); }
+    for(int i = 0; i < 1000; ++i) { cache.insert("user" + std::to_string(i), &span, &matched, 1); }
+    std::vector<RegexBatch::Span> spans;
+    std::vector<uint8_t> flags;
+    if(!cache.find("user", spans, flags) || cache.getStats().entries != 1) {
+        std::cerr << "TokenCache must add a record on its second miss\n";
+        return 1;
+    }
+    return 0;
+}
+
+// gzip member with stored deflate blocks, so that tests don't need zlib
+static std::string gzipStored(const std::string& data) {
+    uint32_t crc = 0xffffffff;
+    for(const char c: data) {
+        crc ^= static_cast<unsigned char>(c);
+        for(int k = 0; k < 8; ++k) { crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1))); }
+    }
+    crc = ~crc;
+
+    auto le = [](std::string& out, uint32_t v, int bytes) {
+        for(int i = 0; i < bytes; ++i) { out += static_cast<char>((v >> (8 * i)) & 0xff); }
+    };
+    std::string res = std::string("\x1f\x8b\x08\0\0\0\0\0\0\xff", 10);
+    size_t pos = 0;
+    do {
+        const size_t len = std::min<size_t>(data.size() - pos, 1000);
+        res += static_cast<char>(pos + len == data.size() ? 1 : 0);
+        le(res, len, 2);
+        le(res, ~len, 2);
+        res.append(data, pos, len);
+        pos += len;
+    } while(pos < data.size());
+    le(res, crc, 4);
+    le(res, data.size(), 4);
+    return res;
+}
+
+// stream of a string that, like a pipe, can't seek or put back
+// more than the last byte
+class PipeBuf: public std::streambuf {
+public:
+    explicit PipeBuf(const std::string& str): str(str) {}
+
+protected:
+    int_type underflow() override {
+        if(pos == str.size()) { return traits_type::eof(); }
+        cur = str[pos++];
+        setg(&cur, &cur, &cur + 1);
+        return traits_type::to_int_type(cur);
+    }
+
+private:
+    std::string str;
+    size_t pos = 0;
+    char cur = 0;
+};
+
+// everything a block reader gives
+static std::string readAll(BlockReader& reader) {
+    std::string res;
+    const char* block;
+    size_t len;
+    while(reader.next(&block, &len)) { res.append(block, len); }
+    return res;
+}
+
+int testBlockReader() {
+    const std::string path = "regextest_blocks.txt";
+    std::string str;
+    for(int i = 0; i < 500; ++i) { str += "abc=" + std::to_string(i) + " ключ=" + std::to_string(i * 7) + '\n'; }
+    {
+        std::ofstream out(path, std::ios::binary);
+        out << str;
+    }
+
+    RegexLexer l("([a-zа-я]+)=([0-9]+)$");
+    RegexData data(str);
+    std::vector<std::string> desired;
+    const char* start;
+    const char* end;
+    while(l.getToken(&start, &end, data)) {
+        desired.push_back(describeToken(start, end, str.data(), data.groups));
+    }
+
+    // block sizes splitting tokens and units, and rings of one to four blocks
+    for(const size_t blockSize: { 1, 5, 64, 4096 }) {
+        for(const size_t blockCount: { 1, 2, 4 }) {
+            std::string err;
+            auto reader = BlockReader::fromFile(path, &err, blockSize, blockCount);
+            if(!reader) {
+                std::cerr << "can't open block reader: " << err << '\n';
+                return 1;
+            }
+
+            std::vector<std::string> res;
+            reader->feedAll(l, [&](const char* start, const char* end, RegexData& data) {
+                res.push_back(describeToken(start, end, data.str, data.groups));
+            });
+            if(res != desired || reader->failed()) {
+                std::cerr << "block reader with blocks of " << blockSize << " gave " << res.size()
+                    << " tokens, desired " << desired.size() << '\n';
+                return 1;
+            }
+        }
+    }
+
+    // stopped before reading everything
+    std::stringstream in(str);
+    {
+        BlockReader reader(in, 16, 2);
+        const char* block;
+        size_t len;
+        if(!reader.next(&block, &len) || std::string(block, len) != str.substr(0, 16)) {
+            std::cerr << "block reader must give the first block\n";
+            return 1;
+        }
+    }
+
+    if(BlockReader::supports(BlockReader::GZIP)) {
+        // two members, as concatenated .gz files are
+        const std::string gz = gzipStored(str.substr(0, 5000)) + gzipStored(str.substr(5000));
+        const std::string gzPath = "regextest_blocks.txt.gz";
+        {
+            std::ofstream out(gzPath, std::ios::binary);
+            out << gz;
+        }
+
+        auto reader = BlockReader::fromFile(gzPath, nullptr, 100);
+        std::vector<std::string> res;
+        reader->feedAll(l, [&](const char* start, const char* end, RegexData& data) {
+            res.push_back(describeToken(start, end, data.str, data.groups));
+        });
+        if(res != desired || reader->failed()) {
+            std::cerr << "gzip block reader gave " << res.size() << " tokens, desired " << desired.size() << '\n';
+            return 1;
+        }
+
+        std::stringstream truncated(gz.substr(0, gz.size() - 100));
+        BlockReader truncatedReader(truncated, 100, 2, BlockReader::GZIP);
+        const char* block;
+        size_t len;
+        while(truncatedReader.next(&block, &len)) {}
+        if(!truncatedReader.failed()) {
+            std::cerr << "truncated gzip must fail\n";
+            return 1;
+        }
+    }
+
+    // compression detected on streams that can't seek back
+    for(const std::string& plain: { "(ab) " + str, std::string("(a"), std::string() }) {
+        PipeBuf buf(plain);
+        std::istream pipe(&buf);
+        BlockReader reader(pipe, 7, 2, BlockReader::DETECT);
+        if(readAll(reader) != plain || reader.failed()) {
+            std::cerr << "block reader must keep bytes it detected compression by on a pipe\n";
+            return 1;
+        }
+    }
+    if(BlockReader::supports(BlockReader::GZIP)) {
+        PipeBuf buf(gzipStored(str));
+        std::istream pipe(&buf);
+        BlockReader reader(pipe, 100, 2, BlockReader::DETECT);
+        if(readAll(reader) != str || reader.failed()) {
+            std::cerr << "gzip on a pipe must be detected\n";
+            return 1;
+        }
+    }
+
+    if(BlockReader::fromFile("regextest_no_such_file.txt") != nullptr) {
+        std::cerr << "block reader of missing file must fail\n";
+        return 1;
+    }
+    return 0;
+}
+
 int main() {
     LexerTestCase t = LexerTestCase::create(
         "a",
@@ -520,6 +1692,25 @@ int main() {
     fail |= t.testAndLog<RegexLexer>();
 
     fail |= testGroups();
+    fail |= testImage();
+    fail |= testCache();
+    fail |= testStats();
+    fail |= testProfile();
+    fail |= testLimits();
+    fail |= testStackLimit();
+    fail |= testLengthBounds();
+    fail |= testMemoize();
+    fail |= testAnalysis();
+    fail |= testBits();
+    fail |= testOnePass();
+    fail |= testLazyGroups();
+    fail |= testPush();
+    fail |= testRange();
+    fail |= testMatch();
+    fail |= testBlockReader();
+    fail |= testBatchLexer();
+    fail |= testLineTokens();
+    fail |= testTokenCache();
 
     return fail;
 }
@@ -0,0 +1,129 @@
+#include <dlexer/static_regex.hpp>
+#include <dlexer/regex.hpp>
+#include <iostream>
+
+using namespace dlexer;
+
+// static_regex must produce the same tokens and groups as RegexLexer;
+// groups inside repetitions aren't compared, because RegexLexer resets
+// them to -1 instead of the previous iteration's value on backtrack
+template<const char* Pat, bool CheckGroups = true>
+int compareWithDynamic(const std::string& str) {
+    using Static = static_regex<Pat>;
+    RegexLexer l(Pat);
+    RegexData dynData(str);
+    RegexData staticData(str);
+
+    std::string dynOut;
+    std::string staticOut;
+    for(int i = 0;; ++i) {
+        const bool dynRes = l.getToken(dynOut, dynData);
+        const bool staticRes = Static::getToken(staticOut, staticData);
+
+        if(dynRes != staticRes) {
+            std::cerr << "FAIL AT PATTERN: \"" << Pat << "\", STRING: \"" << str << "\"\n"
+                << i << "'th token presence differs: dynamic = " << dynRes
+                << ", static = " << staticRes << '\n';
+            return 1;
+        }
+        if(!dynRes) { return 0; }
+
+        if(dynOut != staticOut) {
+            std::cerr << "FAIL AT PATTERN: \"" << Pat << "\", STRING: \"" << str << "\"\n"
+                << i << "'th tokens don't match: dynamic = \"" << dynOut
+                << "\", static = \"" << staticOut << "\"\n";
+            return 1;
+        }
+
+        for(int g = 0; CheckGroups && g < Static::groupCount; ++g) {
+            const RegexData::Group dg = dynData.groups[g];
+            const RegexData::Group sg = staticData.groups[g];
+            if(dg.start != sg.start || dg.end != sg.end) {
+                std::cerr << "FAIL AT PATTERN: \"" << Pat << "\", STRING: \"" << str << "\"\n"
+                    << "group " << g << " of token \"" << dynOut << "\" differs: "
+                    << "dynamic = (" << dg.start << ", " << dg.end << "), "
+                    << "static = (" << sg.start << ", " << sg.end << ")\n";
+                return 1;
+            }
+        }
+    }
+}
+
+static constexpr char unit[] = "a";
+static constexpr char alt[] = "ab|ba";
+static constexpr char star[] = "a*";
+static constexpr char opt[] = "a?";
+static constexpr char optGroup[] = "(ab)?";
+static constexpr char lazyOpt[] = "(ab)??";
+static constexpr char lazyStar[] = "(ab)*?a";
+static constexpr char lazyPlus[] = "(ab)+?a";
+static constexpr char lazyRange[] = "[a-y]*?z";
+static constexpr char lazyUtf[] = "[а-ю]*?я";
+static constexpr char plusGroup[] = "(aa)+";
+static constexpr char altStar[] = "aa|(a|b)*";
+static constexpr char starAlt[] = "(ab)*|aa";
+static constexpr char atStart[] = "^a|ba";
+static constexpr char lines[] = "(^(a)$\n^)|b";
+static constexpr char escaped[] = "\\(a(ab)";
+static constexpr char negClass[] = "[^a-z]*";
+static constexpr char classes[] = "[1-9]+|[a-z]*";
+static constexpr char comment[] = "//[a-z]*$";
+static constexpr char groups[] = "([а-я]+)|([a-z]+)|([0-9]+)";
+static constexpr char endOrStart[] = "([а-я]+)$|^d";
+static constexpr char word[] = "([a-z]+)";
+static constexpr char cyrillicWord[] = "[а-я]+ ";
+static constexpr char notSpace[] = "[^ ]+";
+static constexpr char lazyWord[] = "[a-z]*?;";
+static constexpr char pairs[] = "(ab)+";
+
+// tokens of a few MB must neither overflow the stack nor differ from
+// RegexLexer, whether the repeated body is a unit or a group
+int testLongTokens() {
+    const size_t len = 4 << 20;
+    std::string letters;
+    std::string cyrillic;
+    std::string abs;
+    for(size_t i = 0; i < len; ++i) {
+        letters += static_cast<char>('a' + i % 26);
+        abs += i % 2 ? 'b' : 'a';
+    }
+    for(size_t i = 0; i < len / 2; ++i) { cyrillic += "ж"; }
+
+    int fail = compareWithDynamic<word>(letters + " 12 " + letters);
+    fail |= compareWithDynamic<cyrillicWord>(cyrillic + " " + cyrillic + " ");
+    fail |= compareWithDynamic<notSpace>(letters + cyrillic + " x");
+    fail |= compareWithDynamic<lazyWord>(letters + ";;");
+    fail |= compareWithDynamic<pairs, false>(abs + " " + abs);
+    return fail;
+}
+
+int main() {
+    static_assert(static_regex<groups>::groupCount == 3);
+
+    int fail = compareWithDynamic<unit>("aa");
+    fail |= compareWithDynamic<unit>("");
+    fail |= compareWithDynamic<alt>("aba abba");
+    fail |= compareWithDynamic<star>("a aa aaa");
+    fail |= compareWithDynamic<opt>("a ba baa");
+    fail |= compareWithDynamic<optGroup>("ab ba abbaa");
+    fail |= compareWithDynamic<lazyOpt>("aba");
+    fail |= compareWithDynamic<lazyStar, false>("aba");
+    fail |= compareWithDynamic<lazyPlus, false>("aba ababa");
+    fail |= compareWithDynamic<lazyRange>("abaz ababaz");
+    fail |= compareWithDynamic<lazyUtf>("абвя абвабвя");
+    fail |= compareWithDynamic<plusGroup, false>("a aa aaa");
+    fail |= compareWithDynamic<altStar, false>("ababaa");
+    fail |= compareWithDynamic<starAlt, false>("ababaa");
+    fail |= compareWithDynamic<atStart>("aba");
+    fail |= compareWithDynamic<lines>("a\na\nb");
+    fail |= compareWithDynamic<escaped>("aab(aab (aab");
+    fail |= compareWithDynamic<negClass>("abc123ая");
+    fail |= compareWithDynamic<classes>("abc123ая");
+    fail |= compareWithDynamic<comment>("asdadasda //abc\nasd//def\n//ghi");
+    fail |= compareWithDynamic<groups>("abc ая 123 a1");
+    fail |= compareWithDynamic<endOrStart>("d d ааа ббб");
+    fail |= compareWithDynamic<pairs, false>("abab aba");
+    fail |= testLongTokens();
+
+    return fail;
+}
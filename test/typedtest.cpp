@@ -1,9 +1,106 @@
 #include <dlexer/typed.hpp>
 #include "common.hpp"
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
 
 using namespace dlexer;
 
+// (type, token) pairs getToken() gives
+static std::vector<std::pair<int, std::string>> tokenizeDynamic(const std::string& pat, const std::string& str) {
+    TypedLexer l(pat);
+    std::stringstream in(str);
+    std::vector<std::pair<int, std::string>> res;
+    std::string token;
+    while(l.getToken(token, in)) { res.push_back({l.data.outType, token}); }
+    return res;
+}
+
+// generated scanner must print the same (type, token) pairs as getToken()
+int compareWithGenerated(const std::string& pat, const std::string& str) {
+    const std::string path = "typed_gen.cpp";
+    TypedLexer l(pat);
+    {
+        std::ofstream out(path);
+        l.writeAsCppProgram(out);
+    }
+
+    std::string desired;
+    for(const auto& [type, token]: tokenizeDynamic(pat, str)) {
+        desired += l.types[type].name;
+        desired += '\t';
+        desired += token;
+        desired += '\n';
+    }
+
+    std::string res;
+    if(!runGeneratedProgram(path, str, res) || res != desired) {
+        std::cerr << "FAIL AT GENERATED PATTERN: \"" << pat << "\", STRING: \"" << str << "\"\n"
+            << "desired:\n" << desired << "res:\n" << res;
+        return 1;
+    }
+    return 0;
+}
+
+// feed() must give the same (type, token) pairs as getToken() however
+// the input is split, also inside units
+int comparePush(const std::string& pat, const std::string& str) {
+    TypedLexer l(pat);
+    const std::vector<std::pair<int, std::string>> desired = tokenizeDynamic(pat, str);
+
+    for(size_t chunk = 1; chunk <= 5; ++chunk) {
+        std::vector<std::pair<int, std::string>> res;
+        auto sink = [&](const std::string& token, int type) { res.push_back({type, token}); };
+        for(size_t i = 0; i < str.size(); i += chunk) {
+            l.feed(str.data() + i, std::min(chunk, str.size() - i), sink);
+        }
+        l.finish(sink);
+
+        if(res != desired) {
+            std::cerr << "FAIL AT PUSH PATTERN: \"" << pat << "\", STRING: \"" << str
+                << "\", CHUNK: " << chunk << "\n";
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// tokens() must give the same (type, token) pairs as getToken()
+int compareRange(const std::string& pat, const std::string& str) {
+    TypedLexer l(pat);
+    const std::vector<std::pair<int, std::string>> desired = tokenizeDynamic(pat, str);
+
+    std::vector<std::pair<int, std::string>> res;
+    for(const TypedLexer::Token& t: l.tokens(str)) { res.push_back({t.type, std::string(t.text)}); }
+    if(res != desired) {
+        std::cerr << "FAIL AT RANGE PATTERN: \"" << pat << "\", STRING: \"" << str << "\"\n";
+        return 1;
+    }
+    return 0;
+}
+
+// runs of a type must be the tokens getToken() gives, and all runs
+// together the whole string
+int compareRuns(const std::string& pat, const std::string& str) {
+    TypedLexer l(pat);
+    const std::vector<std::pair<int, std::string>> desired = tokenizeDynamic(pat, str);
+
+    std::vector<TypedLexer::Run> runs;
+    l.getRuns(str, runs);
+    std::vector<std::pair<int, std::string>> res;
+    size_t pos = 0;
+    for(const TypedLexer::Run& r: runs) {
+        if(r.type != -1) { res.push_back({r.type, str.substr(pos, r.length)}); }
+        pos += r.length;
+    }
+    if(res != desired || pos != str.size()) {
+        std::cerr << "FAIL AT RUNS PATTERN: \"" << pat << "\", STRING: \"" << str << "\"\n";
+        return 1;
+    }
+    return 0;
+}
+
 int main() {
     LexerTestCase t = LexerTestCase::create(
         "word \"abc\"",
@@ -40,5 +137,41 @@ int main() {
     );
     fail |= t.testAndLog<TypedLexer>();
 
+    t = LexerTestCase::create(
+        "word \"abc\" space \" \"",
+        " abc?? abc",
+        " ", "abc", " ", "abc"
+    );
+    fail |= t.testAndLog<TypedLexer>();
+
+    // a unit of two types is of the first one
+    t = LexerTestCase::create(
+        "first \"абв\" second \"вгд\"",
+        "абвгд гдв",
+        "абв", "гд", "гд", "в"
+    );
+    fail |= t.testAndLog<TypedLexer>();
+
+    fail |= compareWithGenerated("word \"abc\" space \" \"", "abc abc");
+    fail |= compareWithGenerated("word \"abc\" space \" \"", " abc?? abc");
+    fail |= compareWithGenerated(
+        "word \"абв\" space \" \" capwordquoted \"АБВ\\\"\"",
+        "абв абвАБВ\"");
+    fail |= compareWithGenerated("digit \"0123456789\" alnum \"abc0123\"", "12ab3c x");
+
+    fail |= comparePush("word \"abc\" space \" \"", " abc?? abc");
+    fail |= comparePush("word \"абв\" space \" \" capword \"АБВ\"", "абв абвАБВ?а");
+    fail |= comparePush("digit \"0123456789\" alnum \"abc0123\"", "12ab3c x");
+
+    fail |= compareRange("word \"abc\" space \" \"", " abc?? abc");
+    fail |= compareRange("word \"абв\" space \" \" capword \"АБВ\"", "абв абвАБВ?а");
+    fail |= compareRange("digit \"0123456789\" alnum \"abc0123\"", "12ab3c x");
+
+    fail |= compareRuns("word \"abc\" space \" \"", " abc?? abc");
+    fail |= compareRuns("word \"абв\" space \" \" capword \"АБВ\"", "абв абвАБВ?а");
+    fail |= compareRuns("digit \"0123456789\" alnum \"abc0123\"", "12ab3c x");
+    fail |= compareRuns("first \"абв\" second \"вгд\"", "абвгд гдв\xd0");
+    fail |= compareWithGenerated("first \"абв\" second \"вгд\"", "абвгд гдв");
+
     return fail;
 }
@@ -0,0 +1,147 @@
+#include <dlexer/tokencache.hpp>
+#include <functional>
+#include <cstring>
+#include <new>
+
+namespace dlexer {
+
+TokenCache::TokenCache(size_t capacity)
+    : capacity(capacity)
+    , seen(new std::atomic<uint64_t>[SeenSlots]())
+{}
+
+void TokenCache::setCapacity(size_t bytes) {
+    capacity = bytes;
+    for(Shard& s: shards) {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.evictUntilFits(bytes / ShardCount);
+    }
+}
+
+size_t TokenCache::getCapacity() const { return capacity; }
+
+bool TokenCache::find(std::string_view record, std::vector<RegexBatch::Span>& spans,
+    std::vector<uint8_t>& matched
+) {
+    if(capacity == 0) { return false; }
+
+    const uint64_t hash = std::hash<std::string_view>()(record);
+    Shard& s = shardOf(hash);
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    const auto found = s.index.find(hash);
+    if(found == s.index.end() || found->second->key() != record) {
+        s.stats.misses++;
+        return false;
+    }
+
+    s.stats.hits++;
+    Entry* e = found->second;
+    s.unlink(e);
+    s.pushFront(e);
+    spans.insert(spans.end(), e->spans(), e->spans() + e->count);
+    matched.insert(matched.end(), e->matched(), e->matched() + e->count);
+    return true;
+}
+
+void TokenCache::insert(std::string_view record, const RegexBatch::Span* spans, const uint8_t* matched,
+    size_t count
+) {
+    if(capacity == 0) { return; }
+
+    const size_t limit = shardCapacity();
+    const size_t bytes = record.size() + count * (sizeof(RegexBatch::Span) + 1);
+    if(bytes > limit) { return; }
+
+    const uint64_t hash = std::hash<std::string_view>()(record);
+    std::atomic<uint64_t>& slot = seen[hash % SeenSlots];
+    if(slot.load(std::memory_order_relaxed) != hash) {
+        slot.store(hash, std::memory_order_relaxed);
+        return;
+    }
+
+    Shard& s = shardOf(hash);
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    const auto found = s.index.find(hash);
+    if(found != s.index.end()) {
+        if(found->second->key() == record) { return; }
+        s.erase(found->second);
+        s.stats.evictions++;
+    }
+    s.evictUntilFits(limit - bytes);
+
+    void* mem = ::operator new(sizeof(Entry) + count * (sizeof(RegexBatch::Span) + 1) + record.size());
+    Entry* e = new(mem) Entry{ nullptr, nullptr, hash, bytes, static_cast<uint32_t>(count),
+        static_cast<uint32_t>(record.size()) };
+    std::memcpy(e->spans(), spans, count * sizeof(RegexBatch::Span));
+    std::memcpy(e->matched(), matched, count);
+    std::memcpy(e->matched() + count, record.data(), record.size());
+    s.pushFront(e);
+    s.index.emplace(hash, e);
+    s.stats.entries++;
+    s.stats.bytes += bytes;
+}
+
+void TokenCache::clear() {
+    for(Shard& s: shards) {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.evictUntilFits(0);
+        s.stats = {};
+    }
+    for(size_t i = 0; i < SeenSlots; ++i) { seen[i].store(0, std::memory_order_relaxed); }
+}
+
+TokenCache::Stats TokenCache::getStats() const {
+    Stats res = {};
+    for(const Shard& s: shards) {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        res.hits += s.stats.hits;
+        res.misses += s.stats.misses;
+        res.evictions += s.stats.evictions;
+        res.entries += s.stats.entries;
+        res.bytes += s.stats.bytes;
+    }
+    return res;
+}
+
+TokenCache::Shard::~Shard() {
+    while(head != nullptr) {
+        Entry* next = head->next;
+        ::operator delete(head);
+        head = next;
+    }
+}
+
+// mutex must be held
+void TokenCache::Shard::unlink(Entry* e) {
+    (e->prev ? e->prev->next : head) = e->next;
+    (e->next ? e->next->prev : tail) = e->prev;
+}
+
+// mutex must be held
+void TokenCache::Shard::pushFront(Entry* e) {
+    e->prev = nullptr;
+    e->next = head;
+    (head ? head->prev : tail) = e;
+    head = e;
+}
+
+// mutex must be held
+void TokenCache::Shard::erase(Entry* e) {
+    stats.bytes -= e->bytes;
+    stats.entries--;
+    index.erase(e->hash);
+    unlink(e);
+    ::operator delete(e);
+}
+
+// mutex must be held
+void TokenCache::Shard::evictUntilFits(size_t limit) {
+    while(stats.bytes > limit) {
+        erase(tail);
+        stats.evictions++;
+    }
+}
+
+} // namespace dlexer
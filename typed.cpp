@@ -2,7 +2,10 @@
 #include <dlexer/common.hpp>
 #include <dlexer/basic.hpp>
 #include <sstream>
+#include <fstream>
 #include <cctype>
+#include <cstring>
+#include <algorithm>
 
 namespace dlexer {
 
@@ -50,12 +53,15 @@ std::vector<TypedLexer::NameContentPair> pairsFromPattern(const std::string& pat
     return pairs;
 }
 
-TypedLexer::TypedLexer(std::vector<NameContentPair>&& types): types(types) {}
+TypedLexer::TypedLexer(std::vector<NameContentPair>&& types): types(types) {
+    table.build(this->types);
+}
 
 TypedLexer::TypedLexer(const std::string& pat): TypedLexer(pairsFromPattern(pat)) {}
 
 void TypedLexer::reprogram(const std::string& pat) {
     types = pairsFromPattern(pat);
+    table.build(types);
     endCurTokenList();
 }
 
@@ -63,6 +69,59 @@ bool TypedLexer::getToken(std::string& out, std::istream& in) {
     return getToken(out, in, this->data);
 }
 
+static uint64_t unitKey(const char* unit, int ulen) {
+    uint64_t key = 0;
+    for(int i = 0; i < ulen; ++i) {
+        key = (key << 8) | static_cast<unsigned char>(unit[i]);
+    }
+    return key;
+}
+
+// a unit cut by the end of a content isn't in it, as in findUnit()
+void TypedLexer::TypeTable::build(const std::vector<NameContentPair>& types) {
+    std::fill(byteType, byteType + 256, -1);
+    multi.clear();
+
+    // backwards, so that the first type containing a unit wins
+    for(int t = static_cast<int>(types.size()) - 1; t >= 0; --t) {
+        const std::string& cnt = types[t].content;
+        for(size_t i = 0; i < cnt.size(); i += unitLength(cnt[i])) {
+            const int ulen = unitLength(cnt[i]);
+            const unsigned char first = static_cast<unsigned char>(cnt[i]);
+            if(ulen == 1) {
+                byteType[first] = t;
+                continue;
+            }
+            if(i + ulen > cnt.size()) { break; }
+
+            byteType[first] = -2;
+            multi.push_back({ unitKey(cnt.data() + i, ulen), t });
+        }
+    }
+
+    // stable, so that the first of equal keys is of the first type
+    std::reverse(multi.begin(), multi.end());
+    std::stable_sort(multi.begin(), multi.end(), [](const std::pair<uint64_t, int>& l, const std::pair<uint64_t, int>& r) {
+        return l.first < r.first;
+    });
+    multi.erase(std::unique(multi.begin(), multi.end(), [](const std::pair<uint64_t, int>& l, const std::pair<uint64_t, int>& r) {
+        return l.first == r.first;
+    }), multi.end());
+}
+
+int TypedLexer::TypeTable::typeOf(const char* unit, int ulen) const {
+    const int t = byteType[static_cast<unsigned char>(unit[0])];
+    if(t != -2) { return t; }
+    // cut by the end of input
+    if(ulen != unitLength(unit[0])) { return -1; }
+
+    const uint64_t key = unitKey(unit, ulen);
+    const auto it = std::lower_bound(multi.begin(), multi.end(), key, [](const std::pair<uint64_t, int>& e, uint64_t k) {
+        return e.first < k;
+    });
+    return it != multi.end() && it->first == key ? it->second : -1;
+}
+
 bool TypedLexer::getToken(std::string& out, std::istream& in, Data& data) const {
     if(in.eof()) {
         return false;
@@ -83,18 +142,16 @@ bool TypedLexer::getToken(std::string& out, std::istream& in, Data& data) const
             return out.length() != 0;
         }
 
-        data.curType = -1;
-        for(int i = 0; i < types.size(); ++i) {
-            const std::string& cnt = types[i].content;
-            const int uind = findUnit(cnt.data(), cnt.size(), data.unit, ulen);
-            if(uind == -1) { continue; }
-
-            data.curType = i;
-            break;
-        }
+        data.curType = table.typeOf(data.unit, ulen);
         if(data.curType == -1 || data.outType != data.curType) {
+            if(out.length() == 0) {
+                if(data.curType != -1) {
+                    data.outType = data.curType;
+                    out.append(data.unit, ulen);
+                }
+                continue;
+            }
             data.toIncludePrev = (data.curType != -1);
-            if(out.length() == 0) { continue; }
             return true;
         }
         out.append(data.unit, ulen);
@@ -105,4 +162,181 @@ void TypedLexer::endCurTokenList() {
     data = {0};
 }
 
+/****************************** TOKEN RANGE *******************************/
+
+TypedLexer::TokenRange TypedLexer::tokens(std::string_view str) const {
+    return TokenRange{ TokenIterator(*this, str) };
+}
+
+TypedLexer::TokenIterator::TokenIterator(const TypedLexer& lexer, std::string_view str)
+    : lexer(&lexer)
+    , str(str)
+{
+    ++*this;
+}
+
+TypedLexer::TokenIterator& TypedLexer::TokenIterator::operator++() {
+    if(!lexer->getToken(token, str, data)) {
+        lexer = nullptr;
+        data.pos = 0;
+    }
+    return *this;
+}
+
+// getToken() over the string, a token grows by whole units instead of
+// being appended to
+bool TypedLexer::getToken(Token& out, std::string_view str, StrData& data) const {
+    size_t start = std::string_view::npos;
+    size_t end = 0;
+    auto append = [&]() {
+        if(start == std::string_view::npos) { start = data.unitPos; }
+        end = data.unitPos + data.ulen;
+    };
+
+    if(data.toIncludePrev) {
+        append();
+        data.toIncludePrev = false;
+        data.outType = data.curType;
+    }
+
+    while(true) {
+        if(data.pos >= str.size()) {
+            if(start != std::string_view::npos) { break; }
+            return false;
+        }
+        data.unitPos = data.pos;
+        data.ulen = std::min<size_t>(unitLength(str[data.pos]), str.size() - data.pos);
+        data.pos += data.ulen;
+
+        data.curType = table.typeOf(str.data() + data.unitPos, data.ulen);
+        if(data.curType == -1 || data.outType != data.curType) {
+            if(start == std::string_view::npos) {
+                if(data.curType != -1) {
+                    data.outType = data.curType;
+                    append();
+                }
+                continue;
+            }
+            data.toIncludePrev = (data.curType != -1);
+            break;
+        }
+        append();
+    }
+    out.text = str.substr(start, end - start);
+    out.type = data.outType;
+    return true;
+}
+
+/******************************** RUNS ************************************/
+
+// a run of ASCII costs a load and a compare per byte
+void TypedLexer::getRuns(std::string_view str, std::vector<Run>& out) const {
+    out.clear();
+    const char* p = str.data();
+    const char* const end = p + str.size();
+    while(p < end) {
+        int type;
+        size_t ulen = 1;
+        const unsigned char c = static_cast<unsigned char>(*p);
+        if(c < 0x80) {
+            type = table.byteType[c];
+        } else {
+            ulen = std::min<size_t>(unitLength(*p), end - p);
+            type = table.typeOf(p, ulen);
+        }
+
+        if(out.empty() || out.back().type != type) { out.push_back(Run{ type, 0 }); }
+        out.back().length += ulen;
+        p += ulen;
+    }
+}
+
+/******************************** PUSH API ********************************/
+
+// getToken() loop body after a unit is read; a token ends at the first
+// unit of another type, which starts the next one
+static void pushUnit(const TypedLexer& l, const char* unit, int ulen, TypedLexer::PushState& st, const TypedLexer::Sink& sink) {
+    TypedLexer::Data& data = st.data;
+    std::memcpy(data.unit, unit, ulen);
+    data.curType = l.table.typeOf(unit, ulen);
+
+    if(data.curType != -1 && data.outType == data.curType) {
+        st.out.append(unit, ulen);
+        return;
+    }
+    if(st.out.length() == 0) {
+        if(data.curType != -1) {
+            data.outType = data.curType;
+            st.out.append(unit, ulen);
+        }
+        return;
+    }
+
+    sink(st.out, data.outType);
+    st.out.clear();
+    if(data.curType != -1) {
+        st.out.append(unit, ulen);
+        data.outType = data.curType;
+    }
+}
+
+void TypedLexer::feed(const char* chunk, size_t len, const Sink& sink) {
+    feed(chunk, len, pushState, sink);
+}
+
+void TypedLexer::finish(const Sink& sink) {
+    finish(pushState, sink);
+}
+
+void TypedLexer::feed(const char* chunk, size_t len, PushState& state, const Sink& sink) const {
+    feedUnits(chunk, len, state.partial, state.partialLen, [&](const char* unit, int ulen) {
+        pushUnit(*this, unit, ulen, state, sink);
+    });
+}
+
+void TypedLexer::finish(PushState& state, const Sink& sink) const {
+    if(state.out.length() != 0) { sink(state.out, state.data.outType); }
+    state = PushState();
+}
+
+/************************** PROGRAM GENERATION ****************************/
+
+void TypedLexer::writeAsCppProgram(std::ofstream& out) const {
+    std::string mid = "const char* const typeNames[] = {\n";
+    for(const NameContentPair& type: types) {
+        mid += "    ";
+        mid += escapeAsCString(type.name.data(), type.name.size());
+        mid += ",\n";
+    }
+    mid += "    nullptr,\n};\n\n";
+
+    mid += "const short byteType[256] = {";
+    for(int b = 0; b < 256; ++b) {
+        if(b % 16 == 0) { mid += "\n   "; }
+        mid += ' ';
+        mid += std::to_string(table.byteType[b]);
+        mid += ',';
+    }
+    mid += "\n};\n\n";
+
+    // the generated scanner keys units of up to 4 bytes, as UTF-8 has
+    mid += "inline int multiType(unsigned key) {\n"
+        "    switch(key) {\n";
+    for(const std::pair<uint64_t, int>& m: table.multi) {
+        if(m.first > UINT32_MAX) { continue; }
+        mid += "    case ";
+        mid += std::to_string(m.first);
+        mid += "u: return ";
+        mid += std::to_string(m.second);
+        mid += ";\n";
+    }
+    mid += "    default: return -1;\n"
+        "    }\n"
+        "}\n";
+
+    out << readTemplate("templates/typed/prelude.cpp");
+    out << mid;
+    out << readTemplate("templates/typed/post.cpp");
+}
+
 } // namespace dlexer